@@ -0,0 +1,357 @@
+// Block device mapping layer, between the buffer cache and the virtio
+// disks. fsinit reads the layout from the superblock (see bdev.h) and
+// picks its operations; until then blocks map to the original
+// two-region RAID-1 image, which is enough to read the superblock.
+//
+// RAID-1 keeps the test hooks (force_fail, force_disk_fail), which
+// apply to members 0 and 1, the write-intent map in raid.c and the
+// event counters in raidstat.c.
+// RAID-10 mirrors within each pair but has neither. Reads of a block
+// with several copies go to the member with fewer reads in flight, or
+// on a tie to the one whose last read was nearest, and fall back to the
+// other copies on error.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "buf.h"
+#include "bdev.h"
+#include "raidstat.h"
+
+extern int force_read_error_pbn;
+extern int force_disk_fail_id;
+extern int raid_verbose;
+
+// Print an I/O diagnostic, in verbose mode only.
+#define BWTRACE(...)                                                           \
+    do                                                                         \
+    {                                                                          \
+        if (raid_verbose)                                                      \
+            printf(__VA_ARGS__);                                               \
+    } while (0)
+
+struct bdev_ops
+{
+    char *name;
+    int (*read)(struct buf *b);   // fill b with block b->blockno
+    void (*write)(struct buf *b); // write b to block b->blockno
+};
+
+static struct
+{
+    struct superblock geo; // layout fields only
+    struct bdev_ops *ops;
+
+    struct spinlock lock; // protects the balancing state
+    int inflight[NMEMBER];
+    uint lastpos[NMEMBER];
+
+    uint lastio; // ticks at the last bdev_read or bdev_write
+} bdev;
+
+static uint distance(uint a, uint b) { return a > b ? a - b : b - a; }
+
+static int readcopy(struct buf *b, struct pblock *pb)
+{
+    return virtio_disk_rwv(b, pb, 1, 0) ? -1 : 0;
+}
+
+// Read b from one of its n copies, skipping copies for which raid_stale
+// says the member is behind (RAID-1 only, which also counts events).
+static int balancedread(struct buf *b, struct pblock *pb, int *member, int n)
+{
+    int best = -1, r;
+
+    acquire(&bdev.lock);
+    for (int i = 0; i < n; i++)
+    {
+        if (bdev.geo.layout == LAYOUT_RAID1 && raid_stale(b->blockno, i))
+            continue;
+        if (best < 0 ||
+            bdev.inflight[member[i]] < bdev.inflight[member[best]] ||
+            (bdev.inflight[member[i]] == bdev.inflight[member[best]] &&
+             distance(pb[i].blockno, bdev.lastpos[member[i]]) <
+                 distance(pb[best].blockno, bdev.lastpos[member[best]])))
+            best = i;
+    }
+    if (best < 0)
+        best = 0;
+    bdev.inflight[member[best]]++;
+    bdev.lastpos[member[best]] = pb[best].blockno;
+    release(&bdev.lock);
+
+    r = readcopy(b, &pb[best]);
+
+    acquire(&bdev.lock);
+    bdev.inflight[member[best]]--;
+    release(&bdev.lock);
+
+    if (bdev.geo.layout == LAYOUT_RAID1)
+        raid_event(RS_READ, best, b->blockno, pb[best].blockno);
+    for (int i = 0; r < 0 && i < n; i++)
+    {
+        if (i == best)
+            continue;
+        BWTRACE("bread: block %d failed on member %d, trying member %d\n",
+                b->blockno, member[best], member[i]);
+        raid_event(RS_FALLBACK, i, b->blockno, pb[i].blockno);
+        r = readcopy(b, &pb[i]);
+    }
+    return r;
+}
+
+static int raid1_read(struct buf *b)
+{
+    struct pblock pb[NMEMBER];
+    int member[NMEMBER], n;
+    int fail_disk = force_disk_fail_id;
+    int is_pbn0_block_fail =
+        (force_read_error_pbn == b->blockno && force_read_error_pbn != -1);
+
+    n = bmapcopies(&bdev.geo, b->blockno, pb, member);
+    if (fail_disk == 0 || is_pbn0_block_fail)
+    {
+        raid_event(RS_FALLBACK, 1, b->blockno, pb[1].blockno);
+        return readcopy(b, &pb[1]);
+    }
+    if (fail_disk == 1)
+    {
+        raid_event(RS_FALLBACK, 0, b->blockno, pb[0].blockno);
+        return readcopy(b, &pb[0]);
+    }
+    return balancedread(b, pb, member, n);
+}
+
+static void raid1_write(struct buf *b)
+{
+    struct pblock pb[NMEMBER], go[NMEMBER];
+    int cp[NMEMBER]; // copy number of go[i]
+    int n, ngo = 0, failed = 0;
+
+    n = bmapcopies(&bdev.geo, b->blockno, pb, 0);
+
+    int pbn0 = pb[0].blockno;
+    int pbn1 = pb[1].blockno;
+
+    int sim_disk_fail = force_disk_fail_id;
+    int sim_pbn0_block_fail =
+        (force_read_error_pbn == b->blockno && force_read_error_pbn != -1);
+
+    BWTRACE(
+        "BW_DIAG: PBN0=%d, PBN1=%d, sim_disk_fail=%d, sim_pbn0_block_fail=%d\n",
+        pbn0, pbn1, sim_disk_fail, sim_pbn0_block_fail);
+
+    // submit the copies together, and leave b->blockno alone.
+    // a copy that is skipped is marked for resync first.
+    if (sim_disk_fail == 0)
+    {
+        BWTRACE(
+            "BW_ACTION: SKIP_PBN0 (PBN %d) due to simulated Disk 0 failure.\n",
+            pbn0);
+        raid_event(RS_SKIP_DISK, 0, b->blockno, pbn0);
+        raid_markdirty(b->blockno, 0);
+    }
+    else if (sim_pbn0_block_fail)
+    {
+        BWTRACE("BW_ACTION: SKIP_PBN0 (PBN %d) due to simulated PBN0 block "
+                "failure.\n",
+                pbn0);
+        raid_event(RS_SKIP_BLOCK, 0, b->blockno, pbn0);
+        raid_markdirty(b->blockno, 0);
+    }
+    else
+    {
+        BWTRACE("BW_ACTION: ATTEMPT_PBN0 (PBN %d).\n", pbn0);
+        cp[ngo] = 0;
+        go[ngo++] = pb[0];
+    }
+
+    if (sim_disk_fail == 1)
+    {
+        BWTRACE(
+            "BW_ACTION: SKIP_PBN1 (PBN %d) due to simulated Disk 1 failure.\n",
+            pbn1);
+        raid_event(RS_SKIP_DISK, 1, b->blockno, pbn1);
+        raid_markdirty(b->blockno, 1);
+    }
+    else
+    {
+        BWTRACE("BW_ACTION: ATTEMPT_PBN1 (PBN %d).\n", pbn1);
+        cp[ngo] = 1;
+        go[ngo++] = pb[1];
+    }
+
+    for (int i = 2; i < n; i++)
+    {
+        cp[ngo] = i;
+        go[ngo++] = pb[i];
+    }
+
+    if (ngo > 0)
+        failed = virtio_disk_rwv(b, go, ngo, 1);
+    for (int i = 0; i < ngo; i++)
+    {
+        if (failed & (1 << i))
+        {
+            printf("bwrite: write of PBN %d on disk %d failed\n",
+                   go[i].blockno, go[i].disk);
+            raid_event(RS_WRITE_ERR, cp[i], b->blockno, go[i].blockno);
+            if (cp[i] < 2)
+                raid_markdirty(b->blockno, cp[i]);
+        }
+        else
+            raid_event(RS_WRITE, cp[i], b->blockno, go[i].blockno);
+    }
+    if (ngo > 0 && failed == (1 << ngo) - 1)
+        panic("bwrite: no copy written");
+    if (ngo == n && failed == 0)
+        raid_markclean(b->blockno);
+}
+
+static int raid0_read(struct buf *b)
+{
+    struct pblock pb;
+
+    bmapcopies(&bdev.geo, b->blockno, &pb, 0);
+    return readcopy(b, &pb);
+}
+
+static void raid0_write(struct buf *b)
+{
+    struct pblock pb;
+
+    bmapcopies(&bdev.geo, b->blockno, &pb, 0);
+    if (virtio_disk_rwv(b, &pb, 1, 1) != 0)
+        panic("bwrite: write failed");
+}
+
+static int raid10_read(struct buf *b)
+{
+    struct pblock pb[2];
+    int member[2];
+
+    bmapcopies(&bdev.geo, b->blockno, pb, member);
+    return balancedread(b, pb, member, 2);
+}
+
+static void raid10_write(struct buf *b)
+{
+    struct pblock pb[2];
+    int failed;
+
+    bmapcopies(&bdev.geo, b->blockno, pb, 0);
+    if ((failed = virtio_disk_rwv(b, pb, 2, 1)) != 0)
+    {
+        for (int i = 0; i < 2; i++)
+            if (failed & (1 << i))
+                printf("bwrite: write of PBN %d on disk %d failed\n",
+                       pb[i].blockno, pb[i].disk);
+        if (failed == 3)
+            panic("bwrite: no copy written");
+    }
+}
+
+static struct bdev_ops layouts[] = {
+    [LAYOUT_RAID1] {"raid1", raid1_read, raid1_write},
+    [LAYOUT_RAID0] {"raid0", raid0_read, raid0_write},
+    [LAYOUT_RAID10] {"raid10", raid10_read, raid10_write},
+};
+
+void bdevinit(void)
+{
+    initlock(&bdev.lock, "bdev");
+    bdev.geo.layout = LAYOUT_RAID1;
+    bdev.geo.ndisk = 1;
+    bdev.geo.nmember = 2;
+    bdev.geo.msize = LOGICAL_DISK_SIZE;
+    bdev.ops = &layouts[LAYOUT_RAID1];
+}
+
+// Switch to the layout recorded in sb. Images made before layouts
+// were recorded have nmember == 0 and keep the default.
+void bdev_configure(struct superblock *sb)
+{
+    if (sb->nmember == 0)
+        return;
+    if (sb->layout >= NELEM(layouts) || sb->nmember > NMEMBER ||
+        sb->ndisk == 0 || sb->ndisk > NDISK || sb->nmember % sb->ndisk ||
+        (sb->layout == LAYOUT_RAID1 && sb->nmember < 2) ||
+        (sb->layout == LAYOUT_RAID10 && sb->nmember % 2) ||
+        (sb->layout != LAYOUT_RAID1 && sb->chunk == 0))
+        panic("bdev: bad layout in superblock");
+    for (int d = 0; d < sb->ndisk; d++)
+        if (!virtio_disk_present(d))
+            panic("bdev: layout needs more virtio disks");
+
+    bdev.geo.layout = sb->layout;
+    bdev.geo.ndisk = sb->ndisk;
+    bdev.geo.nmember = sb->nmember;
+    bdev.geo.msize = sb->msize;
+    bdev.geo.chunk = sb->chunk;
+    bdev.ops = &layouts[sb->layout];
+    BWTRACE("bdev: %s, %d members on %d disks, chunk %d\n", bdev.ops->name,
+            sb->nmember, sb->ndisk, sb->chunk);
+}
+
+int bdev_read(struct buf *b)
+{
+    bdev.lastio = ticks;
+    return bdev.ops->read(b);
+}
+
+void bdev_write(struct buf *b)
+{
+    bdev.lastio = ticks;
+    bdev.ops->write(b);
+}
+
+// Ticks since the buffer cache last did I/O, for the scrubber.
+uint bdev_idle(void) { return ticks - bdev.lastio; }
+
+// Copy i of logical block lbn, for raid.c. Returns 0 if there is none.
+int bdev_locate(uint lbn, int i, struct pblock *pb)
+{
+    struct pblock all[NMEMBER];
+
+    if (i >= bmapcopies(&bdev.geo, lbn, all, 0))
+        return 0;
+    *pb = all[i];
+    return 1;
+}
+
+// The logical block that has a copy at pb, for raw I/O, which must
+// keep the cache in step with what it writes. Returns 0 if there is
+// none.
+int bdev_logical(struct pblock *pb, uint *lbn)
+{
+    struct superblock *g = &bdev.geo;
+    uint m, mb, stripe;
+
+    if (g->msize == 0)
+        return 0;
+    m = pb->blockno / g->msize * g->ndisk + pb->disk;
+    mb = pb->blockno % g->msize;
+    if (m >= g->nmember)
+        return 0;
+
+    switch (g->layout)
+    {
+    case LAYOUT_RAID0:
+        stripe = mb / g->chunk * g->nmember + m;
+        break;
+    case LAYOUT_RAID10:
+        stripe = mb / g->chunk * (g->nmember / 2) + m / 2;
+        break;
+    default:
+        *lbn = mb;
+        return 1;
+    }
+    *lbn = stripe * g->chunk + mb % g->chunk;
+    return 1;
+}
+
+int bdev_mirrored(void) { return bdev.geo.layout == LAYOUT_RAID1; }
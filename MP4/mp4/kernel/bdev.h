@@ -0,0 +1,61 @@
+// Block device layouts. mkfs picks one and records it in the superblock;
+// the kernel's bdev layer and mkfs both map logical blocks with bmapcopies.
+//
+// A layout spreads the file system over nmember members. With one disk,
+// the members are equal regions of msize blocks on it, which is how the
+// original RAID-1 image keeps its mirror at DISK1_START_BLOCK; with
+// several disks, member m is on disk m % ndisk.
+
+#define LAYOUT_RAID1 0  // every member holds a copy of every block
+#define LAYOUT_RAID0 1  // chunks of blocks striped across the members
+#define LAYOUT_RAID10 2 // chunks striped across mirrored pairs of members
+
+#define NMEMBER 4 // most members in a layout
+
+// A block on one of the virtio disks.
+struct pblock
+{
+    int disk;
+    uint blockno;
+};
+
+// Fill pb[] with the copies of logical block lbn under the layout in
+// sb, and member[] with their members if it is non-zero. Returns how
+// many copies there are.
+static inline int bmapcopies(struct superblock *sb, uint lbn, struct pblock *pb,
+                             int *member)
+{
+    int m[NMEMBER], n, i;
+    uint chunk = sb->chunk, nsets, mb;
+
+    switch (sb->layout)
+    {
+    case LAYOUT_RAID0:
+        n = 1;
+        m[0] = lbn / chunk % sb->nmember;
+        mb = lbn / chunk / sb->nmember * chunk + lbn % chunk;
+        break;
+    case LAYOUT_RAID10:
+        nsets = sb->nmember / 2;
+        n = 2;
+        m[0] = 2 * (lbn / chunk % nsets);
+        m[1] = m[0] + 1;
+        mb = lbn / chunk / nsets * chunk + lbn % chunk;
+        break;
+    default:
+        n = sb->nmember;
+        for (i = 0; i < n; i++)
+            m[i] = i;
+        mb = lbn;
+        break;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        pb[i].disk = m[i] % sb->ndisk;
+        pb[i].blockno = m[i] / sb->ndisk * sb->msize + mb;
+        if (member)
+            member[i] = m[i];
+    }
+    return n;
+}
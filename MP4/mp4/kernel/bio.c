@@ -12,10 +12,29 @@
 extern int force_read_error_pbn;
 extern int force_disk_fail_id;
 
+// Write-back. When a transaction commits, log.c marks its blocks dirty
+// with bdirty instead of writing them home, and a flusher thread
+// writes them later in block order: those that have been dirty for
+// FLUSH_AGE ticks, or all of them once NBUF / FLUSH_RATIO are dirty.
+// A dirty block is still in the log until the log's next checkpoint,
+// which calls bflush first, so a crash before it is written loses
+// nothing.
+//
+// A buffer pinned by an uncommitted transaction may hold uncommitted
+// changes, so the flusher writes only buffers that nobody else holds.
+#define FLUSH_INTERVAL 10 // ticks between flusher runs
+#define FLUSH_AGE 30
+#define FLUSH_RATIO 2
+
+#define FLUSH_AGED 0 // flush(): idle buffers dirty for FLUSH_AGE
+#define FLUSH_IDLE 1 // idle buffers
+#define FLUSH_ALL 2  // all of them
+
 struct
 {
     struct spinlock lock;
     struct buf buf[NBUF];
+    int ndirty;
 
     struct buf head;
 } bcache;
@@ -38,10 +57,26 @@ void binit(void)
     }
 }
 
+// Write b if it is still dirty, unless idle is set and someone else
+// holds b. The caller has taken a reference to b.
+static void writeback(struct buf *b, int idle)
+{
+    int ok;
+
+    acquiresleep(&b->lock);
+    acquire(&bcache.lock);
+    ok = b->dirty && (!idle || b->refcnt == 1);
+    release(&bcache.lock);
+    if (ok)
+        bwrite(b);
+    brelse(b);
+}
+
 struct buf *bget(uint dev, uint blockno)
 {
     struct buf *b;
 
+again:
     acquire(&bcache.lock);
 
     for (b = bcache.head.next; b != &bcache.head; b = b->next)
@@ -57,7 +92,7 @@ struct buf *bget(uint dev, uint blockno)
 
     for (b = bcache.head.prev; b != &bcache.head; b = b->prev)
     {
-        if (b->refcnt == 0)
+        if (b->refcnt == 0 && !b->dirty)
         {
             b->dev = dev;
             b->blockno = blockno;
@@ -68,6 +103,18 @@ struct buf *bget(uint dev, uint blockno)
             return b;
         }
     }
+
+    // every idle buffer is dirty: write back the least recently used.
+    for (b = bcache.head.prev; b != &bcache.head; b = b->prev)
+    {
+        if (b->refcnt == 0)
+        {
+            b->refcnt++;
+            release(&bcache.lock);
+            writeback(b, 1);
+            goto again;
+        }
+    }
     panic("bget: no buffers");
 }
 
@@ -80,80 +127,163 @@ struct buf *bread(uint dev, uint blockno)
 
     b = bget(dev, blockno);
 
-    int need_fallback = (fail_disk == 0) || is_pbn0_block_fail;
+    // a failure hook re-reads a cached block from the other copy, but
+    // not one with changes that are not on disk yet, which it would lose.
+    int need_fallback = ((fail_disk == 0) || is_pbn0_block_fail) &&
+                        b->valid && !bbusy(b);
 
     if (!b->valid || need_fallback)
     {
-        int original_blockno = b->blockno;
-        if (need_fallback)
-        {
-
-            b->blockno = blockno + DISK1_START_BLOCK;
-            virtio_disk_rw(b, 0);
-            b->blockno = original_blockno;
-        }
-        else
-        {
-
-            b->blockno = blockno;
-            virtio_disk_rw(b, 0);
-        }
+        if (bdev_read(b) < 0)
+            panic("bread: no readable copy");
+        csum_check(b);
         b->valid = 1;
     }
     return b;
 }
 
+// Write b's contents to disk, through the block device layout.
 void bwrite(struct buf *b)
 {
     if (!holdingsleep(&b->lock))
         panic("bwrite");
 
-    int pbn0 = b->blockno;
-    int pbn1 = b->blockno + DISK1_START_BLOCK;
-
-    int sim_disk_fail = force_disk_fail_id;
-    int sim_pbn0_block_fail =
-        (force_read_error_pbn == pbn0 && force_read_error_pbn != -1);
+    csum_update(b);
+    bdev_write(b);
 
-    printf(
-        "BW_DIAG: PBN0=%d, PBN1=%d, sim_disk_fail=%d, sim_pbn0_block_fail=%d\n",
-        pbn0, pbn1, sim_disk_fail, sim_pbn0_block_fail);
-
-    int original_blockno = b->blockno;
-
-    if (sim_disk_fail == 0)
+    acquire(&bcache.lock);
+    if (b->dirty)
     {
-        printf(
-            "BW_ACTION: SKIP_PBN0 (PBN %d) due to simulated Disk 0 failure.\n",
-            pbn0);
+        b->dirty = 0;
+        bcache.ndirty--;
     }
-    else if (sim_pbn0_block_fail)
+    release(&bcache.lock);
+}
+
+// Mark b, which holds committed changes, to be written home later.
+// Caller holds b->lock.
+void bdirty(struct buf *b)
+{
+    acquire(&bcache.lock);
+    if (!b->dirty)
     {
-        printf("BW_ACTION: SKIP_PBN0 (PBN %d) due to simulated PBN0 block "
-               "failure.\n",
-               pbn0);
+        b->dirty = 1;
+        b->dirtied = ticks;
+        bcache.ndirty++;
     }
-    else
+    release(&bcache.lock);
+}
+
+// Write dirty buffers chosen by mode (FLUSH_*), in block order.
+static void flush(int mode)
+{
+    struct buf *b, *list[NBUF];
+    int n = 0, all, j;
+
+    acquire(&bcache.lock);
+    all = mode != FLUSH_AGED || bcache.ndirty * FLUSH_RATIO >= NBUF;
+    for (b = bcache.buf; b < bcache.buf + NBUF; b++)
     {
-        printf("BW_ACTION: ATTEMPT_PBN0 (PBN %d).\n", pbn0);
-        b->blockno = pbn0;
-        virtio_disk_rw(b, 1);
+        if (!b->dirty || (mode != FLUSH_ALL && b->refcnt > 0) ||
+            (!all && ticks - b->dirtied < FLUSH_AGE))
+            continue;
+        b->refcnt++;
+        for (j = n++; j > 0 && list[j - 1]->blockno > b->blockno; j--)
+            list[j] = list[j - 1];
+        list[j] = b;
     }
+    release(&bcache.lock);
+
+    for (int i = 0; i < n; i++)
+        writeback(list[i], mode != FLUSH_ALL);
+}
+
+// Write every dirty buffer home. Called by the log's checkpoint, when
+// no transaction is open.
+void bflush(void) { flush(FLUSH_ALL); }
+
+// Write the dirty buffers that no one is using, so that raw disk I/O
+// sees them.
+void bsync(void) { flush(FLUSH_IDLE); }
 
-    if (sim_disk_fail == 1)
+static void flusher(void *arg)
+{
+    uint ticks0;
+
+    for (;;)
     {
-        printf(
-            "BW_ACTION: SKIP_PBN1 (PBN %d) due to simulated Disk 1 failure.\n",
-            pbn1);
+        acquire(&tickslock);
+        ticks0 = ticks;
+        do
+            sleep(&ticks, &tickslock);
+        while (ticks - ticks0 < FLUSH_INTERVAL &&
+               bcache.ndirty * FLUSH_RATIO < NBUF);
+        release(&tickslock);
+        flush(FLUSH_AGED);
     }
-    else
+}
+
+void bflushstart(void)
+{
+    if (kthread_create(flusher, 0, "bflush") < 0)
+        panic("bflushstart");
+}
+
+// Does b, which the caller holds, have changes that are not on disk:
+// committed but not yet written home, or pinned by an open transaction?
+// bread must not replace those.
+int bbusy(struct buf *b)
+{
+    int r;
+
+    acquire(&bcache.lock);
+    r = b->dirty || b->refcnt > 1;
+    release(&bcache.lock);
+    return r;
+}
+
+// The cached buffer for blockno, locked, if it is valid and its
+// contents are on disk; 0 otherwise. Unlike bget, it never takes a
+// buffer for blockno, so raw I/O can look without disturbing the cache.
+struct buf *bpeek(uint dev, uint blockno)
+{
+    struct buf *b;
+    int ok;
+
+    acquire(&bcache.lock);
+    for (b = bcache.head.next; b != &bcache.head; b = b->next)
     {
-        printf("BW_ACTION: ATTEMPT_PBN1 (PBN %d).\n", pbn1);
-        b->blockno = pbn1;
-        virtio_disk_rw(b, 1);
+        if (b->dev == dev && b->blockno == blockno)
+        {
+            b->refcnt++;
+            release(&bcache.lock);
+            acquiresleep(&b->lock);
+            acquire(&bcache.lock);
+            ok = b->valid && !b->dirty;
+            release(&bcache.lock);
+            if (ok)
+                return b;
+            brelse(b);
+            return 0;
+        }
     }
+    release(&bcache.lock);
+    return 0;
+}
+
+// Forget blockno's cached contents unless someone is using it or it is
+// dirty, so that the next bread sees what raw I/O wrote to the disk. A
+// dirty buffer holds committed data that is not home yet, which must win.
+void binval(uint dev, uint blockno)
+{
+    struct buf *b;
 
-    b->blockno = original_blockno;
+    acquire(&bcache.lock);
+    for (b = bcache.head.next; b != &bcache.head; b = b->next)
+        if (b->dev == dev && b->blockno == blockno && b->refcnt == 0 &&
+            !b->dirty)
+            b->valid = 0;
+    release(&bcache.lock);
 }
 
 void brelse(struct buf *b)
@@ -2,6 +2,8 @@ struct buf
 {
     int valid; // has data been read from disk?
     int disk;  // does disk "own" buf?
+    int dirty; // committed contents not yet written home?
+    uint dirtied; // ticks when it became dirty
     uint dev;
     uint blockno;
     struct sleeplock lock;
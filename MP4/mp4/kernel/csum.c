@@ -0,0 +1,300 @@
+// Per-block checksums, to catch blocks that a disk returns silently
+// corrupted.
+//
+// The table covers the inode blocks, the free map and the data blocks,
+// which are only written by installing a logged transaction. bwrite
+// updates a block's sum, and install_trans writes the changed table
+// blocks before the log is cleared, so a crash in between is repaired
+// by replaying the log. The log, the RAID map and the table itself are
+// not covered.
+//
+// When a block read from disk does not match, every usable copy is
+// read. bread gets the first one that matches, and a kernel thread
+// rewrites the bad copies from it in the background.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "bdev.h"
+#include "csum.h"
+#include "raid.h"
+
+#define SPP (PGSIZE / sizeof(uint)) // sums per page of the table
+#define MAXCSUMPG 16                // pages of table, enough for 16384 blocks
+#define NREPAIR 8                   // copies waiting to be rewritten
+
+// A copy to rewrite. data holds the good contents, whose sum is sum.
+struct repair
+{
+    uint blockno;
+    uint sum;
+    struct pblock pb;
+    struct buf *data;
+};
+
+struct
+{
+    struct spinlock lock;
+    int dev;
+    uint start; // first table block, or 0 if there are no checksums
+    uint size;
+    uint inodestart;
+    uint raidmap;
+    uint *pages[MAXCSUMPG]; // the table, protected by lock
+    uchar dirty[MAXCSUMPG * (PGSIZE / BSIZE)];
+
+    struct repair queue[NREPAIR]; // protected by lock
+    int nqueue;
+    uint nbad;      // bad copies found
+    uint nrepaired; // and rewritten
+
+    struct buf iobuf; // for table I/O, under iobuf.lock
+} csum;
+
+uint crc32c_table[4][256]; // filled in by crc32c_init, see csum.h
+
+// Is block b covered by a checksum?
+static int covered(uint b)
+{
+    return csum.start != 0 && b >= csum.inodestart && b < csum.size &&
+           (b < csum.raidmap || b >= csum.raidmap + RAIDMAPBLKS) &&
+           (b < csum.start || b >= csum.start + NCSUMBLK(csum.size));
+}
+
+static uint *slot(uint b) { return &csum.pages[b / SPP][b % SPP]; }
+
+// Table block i, in memory.
+static uchar *tblock(int i)
+{
+    return (uchar *)csum.pages[i / (PGSIZE / BSIZE)] +
+           i % (PGSIZE / BSIZE) * BSIZE;
+}
+
+static int usable(uint b, int copy)
+{
+    return !bdev_mirrored() || raid_usable(b, copy);
+}
+
+// Write table block i to each usable copy, and have resync bring the
+// others up to date.
+static void writetblock(int i)
+{
+    struct pblock pbs[NMEMBER];
+    uint b = csum.start + i;
+    int n = 0;
+
+    acquiresleep(&csum.iobuf.lock);
+    acquire(&csum.lock);
+    memmove(csum.iobuf.data, tblock(i), BSIZE);
+    csum.dirty[i] = 0;
+    release(&csum.lock);
+    for (int c = 0; bdev_locate(b, c, &pbs[n]); c++)
+    {
+        if (usable(b, c))
+            n++;
+        else
+            raid_markdirty(b, c);
+    }
+    if (n > 0 && virtio_disk_rwv(&csum.iobuf, pbs, n, 1) == (1 << n) - 1)
+        panic("csum: cannot write table");
+    releasesleep(&csum.iobuf.lock);
+}
+
+// Record b's new contents. Called by bwrite.
+void csum_update(struct buf *b)
+{
+    uint sum;
+
+    if (!covered(b->blockno))
+        return;
+    sum = crc32c(b->data, BSIZE);
+    acquire(&csum.lock);
+    *slot(b->blockno) = sum;
+    csum.dirty[b->blockno / CPB] = 1;
+    release(&csum.lock);
+}
+
+// Write out the table blocks changed since the last flush.
+void csum_flush(void)
+{
+    int dirty;
+
+    for (int i = 0; i < NCSUMBLK(csum.size); i++)
+    {
+        acquire(&csum.lock);
+        dirty = csum.dirty[i];
+        release(&csum.lock);
+        if (dirty)
+            writetblock(i);
+    }
+}
+
+// Queue copy pb of block b to be rewritten with good, whose sum is sum.
+static void queuerepair(uint b, struct pblock *pb, uint sum, struct buf *good)
+{
+    struct buf *data;
+
+    if ((data = (struct buf *)kalloc()) == 0)
+        return;
+    memmove(data->data, good->data, BSIZE);
+    acquire(&csum.lock);
+    if (csum.nqueue == NREPAIR)
+    {
+        // the next read of b finds it again.
+        release(&csum.lock);
+        kfree(data);
+        return;
+    }
+    csum.queue[csum.nqueue].blockno = b;
+    csum.queue[csum.nqueue].sum = sum;
+    csum.queue[csum.nqueue].pb = *pb;
+    csum.queue[csum.nqueue].data = data;
+    csum.nqueue++;
+    release(&csum.lock);
+    wakeup(&csum);
+}
+
+// b does not match its sum, want. Look for a copy that does.
+static void recover(struct buf *b, uint want)
+{
+    struct pblock pb, bad[NMEMBER];
+    struct buf *t;
+    int nbad = 0, good = 0;
+
+    if ((t = (struct buf *)kalloc()) == 0)
+        panic("csum: recover");
+    for (int c = 0; bdev_locate(b->blockno, c, &pb); c++)
+    {
+        if (!usable(b->blockno, c) || virtio_disk_rwv(t, &pb, 1, 0) != 0)
+            continue;
+        if (crc32c(t->data, BSIZE) != want)
+        {
+            printf("csum: block %d is corrupt on disk %d block %d\n",
+                   b->blockno, pb.disk, pb.blockno);
+            bad[nbad++] = pb;
+        }
+        else if (!good)
+        {
+            memmove(b->data, t->data, BSIZE);
+            good = 1;
+        }
+    }
+    acquire(&csum.lock);
+    csum.nbad += nbad;
+    release(&csum.lock);
+
+    if (!good)
+        printf("csum: block %d has no good copy\n", b->blockno);
+    else
+        for (int i = 0; i < nbad; i++)
+            queuerepair(b->blockno, &bad[i], want, b);
+    kfree(t);
+}
+
+// Does data match block b's checksum? Returns -1 if b has none.
+int csum_match(uint b, uchar *data)
+{
+    uint want;
+
+    if (!covered(b))
+        return -1;
+    acquire(&csum.lock);
+    want = *slot(b);
+    release(&csum.lock);
+    return crc32c(data, BSIZE) == want;
+}
+
+// Check b, just read from disk, and replace its contents with a good
+// copy if it is corrupt. Called by bread with b locked.
+void csum_check(struct buf *b)
+{
+    uint want;
+
+    if (!covered(b->blockno))
+        return;
+    acquire(&csum.lock);
+    want = *slot(b->blockno);
+    release(&csum.lock);
+    if (crc32c(b->data, BSIZE) != want)
+        recover(b, want);
+}
+
+// Rewrite bad copies, holding the block's buffer so that no bwrite of
+// it runs meanwhile. A copy whose block changed since it was queued
+// has already been rewritten by bwrite.
+static void repairer(void *arg)
+{
+    struct repair r;
+    struct buf *bp;
+    int ok;
+
+    for (;;)
+    {
+        acquire(&csum.lock);
+        while (csum.nqueue == 0)
+            sleep(&csum, &csum.lock);
+        r = csum.queue[--csum.nqueue];
+        release(&csum.lock);
+
+        bp = bget(csum.dev, r.blockno);
+        acquire(&csum.lock);
+        ok = *slot(r.blockno) == r.sum;
+        release(&csum.lock);
+        if (ok && virtio_disk_rwv(r.data, &r.pb, 1, 1) == 0)
+        {
+            acquire(&csum.lock);
+            csum.nrepaired++;
+            release(&csum.lock);
+        }
+        brelse(bp);
+        kfree(r.data);
+    }
+}
+
+void csuminit(void)
+{
+    initlock(&csum.lock, "csum");
+    initsleeplock(&csum.iobuf.lock, "csumtable");
+    crc32c_init();
+}
+
+// Load the table and start the repair thread. Called by fsinit before
+// the log is recovered. Images without a table are not checked.
+void csumstart(int dev, struct superblock *sb)
+{
+    struct pblock pb;
+    int c;
+
+    if (sb->csumstart == 0)
+        return;
+    if (NCSUMBLK(sb->size) > NELEM(csum.dirty))
+        panic("csumstart: file system too large");
+
+    csum.dev = dev;
+    csum.size = sb->size;
+    csum.inodestart = sb->inodestart;
+    csum.raidmap = sb->raidmap;
+    for (int i = 0; i * SPP < sb->size; i++)
+        if ((csum.pages[i] = (uint *)kalloc()) == 0)
+            panic("csumstart: kalloc");
+
+    for (int i = 0; i < NCSUMBLK(sb->size); i++)
+    {
+        for (c = 0; bdev_locate(sb->csumstart + i, c, &pb); c++)
+            if (usable(sb->csumstart + i, c) &&
+                virtio_disk_rwv(&csum.iobuf, &pb, 1, 0) == 0)
+                break;
+        if (!bdev_locate(sb->csumstart + i, c, &pb))
+            panic("csumstart: cannot read table");
+        memmove(tblock(i), csum.iobuf.data, BSIZE);
+    }
+    csum.start = sb->csumstart;
+
+    if (kthread_create(repairer, 0, "csumrepair") < 0)
+        panic("csumstart: repair thread");
+}
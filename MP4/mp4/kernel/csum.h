@@ -0,0 +1,48 @@
+// Per-block checksums. mkfs writes a table of CRC32C sums, one uint per
+// logical block, to the blocks starting at sb.csumstart; the kernel
+// keeps it in memory, checks blocks as bread fetches them and updates
+// it in bwrite. Both kernel and mkfs use this header file, and each
+// defines crc32c_table once.
+
+#define CPB (BSIZE / sizeof(uint)) // Checksums per block
+
+// Blocks of checksum table for a file system of size blocks.
+#define NCSUMBLK(size) (((size) + CPB - 1) / CPB)
+
+extern uint crc32c_table[4][256];
+
+// Fill in the tables for crc32c. Call once before using it.
+static inline void crc32c_init(void)
+{
+    uint c;
+
+    for (int i = 0; i < 256; i++)
+    {
+        c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+        crc32c_table[0][i] = c;
+    }
+    for (int i = 0; i < 256; i++)
+        for (int s = 1; s < 4; s++)
+            crc32c_table[s][i] = (crc32c_table[s - 1][i] >> 8) ^
+                                 crc32c_table[0][crc32c_table[s - 1][i] & 0xff];
+}
+
+// CRC32C (Castagnoli) of p[0..n-1], a word at a time with one lookup
+// per byte of the word. The words are assembled byte by byte, so p
+// need not be aligned.
+static inline uint crc32c(const uchar *p, int n)
+{
+    uint c = ~0;
+
+    for (; n >= 4; n -= 4, p += 4)
+    {
+        c ^= p[0] | p[1] << 8 | p[2] << 16 | (uint)p[3] << 24;
+        c = crc32c_table[3][c & 0xff] ^ crc32c_table[2][(c >> 8) & 0xff] ^
+            crc32c_table[1][(c >> 16) & 0xff] ^ crc32c_table[0][c >> 24];
+    }
+    for (; n > 0; n--)
+        c = crc32c_table[0][(c ^ *p++) & 0xff] ^ (c >> 8);
+    return ~c;
+}
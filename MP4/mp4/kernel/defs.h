@@ -1,13 +1,18 @@
 struct buf;
+struct pblock;
 struct context;
 struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct shm;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct fextent;
+struct resyncstat;
+struct scrubstat;
 
 // bio.c
 void binit(void);
@@ -17,6 +22,31 @@ void bwrite(struct buf *);
 void bpin(struct buf *);
 void bunpin(struct buf *);
 struct buf *bget(uint, uint);
+struct buf *bpeek(uint, uint);
+void binval(uint, uint);
+int bbusy(struct buf *);
+void bdirty(struct buf *);
+void bflush(void);
+void bsync(void);
+void bflushstart(void);
+
+// bdev.c
+void bdevinit(void);
+void bdev_configure(struct superblock *);
+int bdev_read(struct buf *);
+void bdev_write(struct buf *);
+int bdev_locate(uint, int, struct pblock *);
+int bdev_logical(struct pblock *, uint *);
+int bdev_mirrored(void);
+uint bdev_idle(void);
+
+// csum.c
+void csuminit(void);
+void csumstart(int, struct superblock *);
+void csum_check(struct buf *);
+void csum_update(struct buf *);
+void csum_flush(void);
+int csum_match(uint, uchar *);
 
 // console.c
 void consoleinit(void);
@@ -38,6 +68,7 @@ int filewrite(struct file *, uint64, int n);
 // fs.c
 void fsinit(int);
 int dirlink(struct inode *, char *, uint);
+void dirunlink(struct inode *, char *, uint);
 struct inode *dirlookup(struct inode *, char *, uint *);
 struct inode *ialloc(uint, short);
 struct inode *idup(struct inode *);
@@ -49,11 +80,13 @@ void iunlockput(struct inode *);
 void iupdate(struct inode *);
 int namecmp(const char *, const char *);
 struct inode *namei(char *);
+struct inode *nameiat(struct inode *, char *);
 struct inode *nameiparent(char *, char *);
 int readi(struct inode *, int, uint64, uint, uint);
 void stati(struct inode *, struct stat *);
 int writei(struct inode *, int, uint64, uint, uint);
 uint bmap(struct inode *, uint);
+int iextents(struct inode *, uint, struct fextent *, int);
 void itrunc(struct inode *);
 
 // ramdisk.c
@@ -65,6 +98,8 @@ void ramdiskrw(struct buf *);
 void *kalloc(void);
 void kfree(void *);
 void kinit(void);
+void kref(void *);
+int krefcnt(void *);
 
 // log.c
 void initlog(int, struct superblock *);
@@ -72,6 +107,17 @@ void log_write(struct buf *);
 void begin_op(void);
 void end_op(void);
 
+// mmap.c
+uint64 mmap(struct file *, uint64, int, int, uint);
+uint64 mmapshm(struct shm *, uint64);
+uint64 vma_shmpa(uint64);
+int munmap(uint64, uint64);
+int vma_overlap(struct proc *, uint64, uint64);
+void vma_unmapall(struct proc *);
+int vma_fork(struct proc *, struct proc *);
+int vma_fault(uint64, int, int);
+void vma_prefault(uint64, uint64, int);
+
 // pipe.c
 int pipealloc(struct file **, struct file **);
 void pipeclose(struct pipe *, int);
@@ -102,10 +148,31 @@ void sleep(void *, struct spinlock *);
 void userinit(void);
 int wait(uint64);
 void wakeup(void *);
+int wakeupn(void *, int);
 void yield(void);
+void preempt(void);
 int either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void procdump(void);
+int kthread_create(void (*)(void *), void *, char *);
+
+// raid.c
+void raidinit(void);
+void raidstart(int, struct superblock *);
+void raid_markdirty(uint, int);
+void raid_markclean(uint);
+int raid_stale(uint, int);
+int raid_usable(uint, int);
+
+// raidstat.c
+void raid_event(int, int, uint, uint);
+int raid_stat(uint64);
+
+// scrub.c
+void scrubstart(int, struct superblock *);
+void scrub_status(struct scrubstat *);
+void raid_kick(void);
+void raid_status(struct resyncstat *);
 
 // swtch.S
 void swtch(struct context *, struct context *);
@@ -118,6 +185,17 @@ void release(struct spinlock *);
 void push_off(void);
 void pop_off(void);
 
+// shm.c
+void shminit(void);
+int shmget(int, uint64);
+uint64 shmat(int);
+int shmrm(int);
+char *shmpage(struct shm *, int);
+void shmdup(struct shm *);
+void shmput(struct shm *);
+int futexwait(uint64, int);
+int futexwake(uint64, int);
+
 // sleeplock.c
 void acquiresleep(struct sleeplock *);
 void releasesleep(struct sleeplock *);
@@ -141,8 +219,17 @@ int fetchstr(uint64, char *, int);
 int fetchaddr(uint64, uint64 *);
 void syscall();
 
+// timer.c
+void timerqinit(void);
+uint64 timer_now(void);
+int sleepuntil(uint64);
+int timerintr(void);
+void timer_kick(void);
+void timer_idle(int);
+
 // trap.c
 extern uint ticks;
+void clockintr(void);
 void trapinit(void);
 void trapinithart(void);
 extern struct spinlock tickslock;
@@ -166,9 +253,12 @@ void uvminit(pagetable_t, uchar *, uint);
 uint64 uvmalloc(pagetable_t, uint64, uint64);
 uint64 uvmdealloc(pagetable_t, uint64, uint64);
 int uvmcopy(pagetable_t, pagetable_t, uint64);
+int uvmcow(pagetable_t, uint64);
+int uvmlazy(pagetable_t, uint64, uint64);
 void uvmfree(pagetable_t, uint64);
 void uvmunmap(pagetable_t, uint64, uint64, int);
 void uvmclear(pagetable_t, uint64);
+pte_t *walk(pagetable_t, uint64, int);
 uint64 walkaddr(pagetable_t, uint64);
 int copyout(pagetable_t, uint64, char *, uint64);
 int copyin(pagetable_t, char *, uint64, uint64);
@@ -182,8 +272,11 @@ void plic_complete(int);
 
 // virtio_disk.c
 void virtio_disk_init(void);
-void virtio_disk_rw(struct buf *, int);
-void virtio_disk_intr(void);
+int virtio_disk_rw(struct buf *, int);
+int virtio_disk_rwv(struct buf *, struct pblock *, int, int);
+int virtio_disk_rwb(struct buf **, struct pblock *, int, int);
+int virtio_disk_present(int);
+void virtio_disk_intr(int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x) / sizeof((x)[0]))
@@ -112,6 +112,7 @@ int exec(char *path, char **argv)
     safestrcpy(p->name, last, sizeof(p->name));
 
     // Commit to the user image.
+    vma_unmapall(p);
     oldpagetable = p->pagetable;
     p->pagetable = pagetable;
     p->sz = sz;
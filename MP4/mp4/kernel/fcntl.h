@@ -4,3 +4,9 @@
 #define O_CREATE 0x200
 #define O_TRUNC 0x400
 #define O_NOACCESS 0x004
+
+// mmap
+#define PROT_READ 0x1
+#define PROT_WRITE 0x2
+#define MAP_SHARED 0x01
+#define MAP_PRIVATE 0x02
@@ -110,6 +110,8 @@ int fileread(struct file *f, uint64 addr, int n)
     if (f->readable == 0)
         return -1;
 
+    // before any lock: a mapped file page cannot be read in under one.
+    vma_prefault(addr, n, 1);
     if (f->type == FD_PIPE)
     {
         r = piperead(f->pipe, addr, n);
@@ -144,6 +146,7 @@ int filewrite(struct file *f, uint64 addr, int n)
     if (f->writable == 0)
         return -1;
 
+    vma_prefault(addr, n, 0);
     if (f->type == FD_PIPE)
     {
         ret = pipewrite(f->pipe, addr, n);
@@ -26,6 +26,9 @@ struct inode
     uint dev;              // Device number
     uint inum;             // Inode number
     int ref;               // Reference count
+    struct inode *hnext;   // icache hash chain
+    struct inode *prev;    // icache LRU list, or free list (next)
+    struct inode *next;
     struct sleeplock lock; // protects everything below here
     int valid;             // inode has been read from disk?
     short type;            // copy of disk inode
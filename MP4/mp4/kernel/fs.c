@@ -25,12 +25,20 @@ static void readsb(int dev, struct superblock *sb)
     brelse(bp);
 }
 
+static void bgroupinit(int dev);
+
 void fsinit(int dev)
 {
     readsb(dev, &sb);
     if (sb.magic != FSMAGIC)
         panic("invalid file system");
+    bdev_configure(&sb);
+    csumstart(dev, &sb);
     initlog(dev, &sb);
+    bflushstart();
+    bgroupinit(dev);
+    raidstart(dev, &sb);
+    scrubstart(dev, &sb);
 }
 
 static void bzero(int dev, int bno)
@@ -43,25 +51,100 @@ static void bzero(int dev, int bno)
     brelse(bp);
 }
 
-static uint balloc(uint dev)
+// Allocation groups. The disk is cut into runs of BPG blocks, each with
+// a count of its free blocks and a rotor below which every block of the
+// group is in use, so balloc skips full groups and allocated prefixes
+// without looking at the bitmap. A group's entries are protected by the
+// lock on the bitmap block covering it.
+#define BPG 256 // blocks per group; divides BPB
+#define MAXGROUP 64
+
+static struct
+{
+    int ngroups;
+    int nfree[MAXGROUP];
+    uint rotor[MAXGROUP];
+} bgroup;
+
+// Count the free blocks of each group, after log recovery.
+static void bgroupinit(int dev)
 {
-    int b, bi, m;
     struct buf *bp;
+    uint b;
+    int g;
+
+    bgroup.ngroups = (sb.size + BPG - 1) / BPG;
+    if (bgroup.ngroups > MAXGROUP)
+        panic("bgroupinit: too many groups");
+    for (g = 0; g < bgroup.ngroups; g++)
+    {
+        bgroup.nfree[g] = 0;
+        bgroup.rotor[g] = g * BPG;
+    }
 
     bp = 0;
-    for (b = 0; b < sb.size; b += BPB)
+    for (b = 0; b < sb.size; b++)
     {
-        bp = bread(dev, BBLOCK(b, sb));
-        for (bi = 0; bi < BPB && b + bi < sb.size; bi++)
+        if (bp == 0 || b % BPB == 0)
         {
-            m = 1 << (bi % 8);
-            if ((bp->data[bi / 8] & m) == 0)
+            if (bp)
+                brelse(bp);
+            bp = bread(dev, BBLOCK(b, sb));
+        }
+        if ((bp->data[(b % BPB) / 8] & (1 << (b % 8))) == 0)
+            bgroup.nfree[b / BPG]++;
+    }
+    if (bp)
+        brelse(bp);
+}
+
+// The group an inode's blocks start out in. Groups are chosen by inode
+// number rather than by hart, so that the same sequence of operations
+// lays files out the same way on every boot.
+static uint ghome(struct inode *ip)
+{
+    return (ip->inum % bgroup.ngroups) * BPG;
+}
+
+// Allocate a zeroed disk block. Take the first free block at or after
+// near, moving on through the following groups, so that a file grown
+// block by block with near = its last block + 1 gets contiguous runs.
+// The last pass comes back to near's own group and scans all of it,
+// for free blocks below near.
+static uint balloc(uint dev, uint near)
+{
+    int k, g, m;
+    uint b, start, end;
+    struct buf *bp;
+
+    if (near >= sb.size)
+        near = 0;
+    for (k = 0; k <= bgroup.ngroups; k++)
+    {
+        g = (near / BPG + k) % bgroup.ngroups;
+        if (bgroup.nfree[g] == 0)
+            continue;
+
+        bp = bread(dev, BBLOCK(g * BPG, sb));
+        start = bgroup.rotor[g];
+        if (k == 0 && near > start)
+            start = near;
+        else if (k == bgroup.ngroups)
+            start = g * BPG;
+        end = min((g + 1) * BPG, sb.size);
+        for (b = start; b < end; b++)
+        {
+            m = 1 << (b % 8);
+            if ((bp->data[(b % BPB) / 8] & m) == 0)
             {
-                bp->data[bi / 8] |= m;
+                bp->data[(b % BPB) / 8] |= m;
+                bgroup.nfree[g]--;
+                if (start == bgroup.rotor[g])
+                    bgroup.rotor[g] = b + 1;
                 log_write(bp);
                 brelse(bp);
-                bzero(dev, b + bi);
-                return b + bi;
+                bzero(dev, b);
+                return b;
             }
         }
         brelse(bp);
@@ -80,25 +163,104 @@ static void bfree(int dev, uint b)
     if ((bp->data[bi / 8] & m) == 0)
         panic("freeing free block");
     bp->data[bi / 8] &= ~m;
+    bgroup.nfree[b / BPG]++;
+    if (b < bgroup.rotor[b / BPG])
+        bgroup.rotor[b / BPG] = b;
     log_write(bp);
     brelse(bp);
 }
 
+// The inode cache grows a page of inodes at a time. Cached inodes are
+// found through a hash on (dev, inum); those with ref == 0 stay valid
+// on an LRU list, most recently used first, until iget needs an entry
+// and the cache already holds NINODE of them or is out of memory.
+#define NIHASH 61
+
 struct
 {
     struct spinlock lock;
-    struct inode inode[NINODE];
+    struct inode *hash[NIHASH];
+    struct inode *free; // never used, linked by next
+    struct inode lru;   // idle inodes, linked by prev/next
+    int n;              // inodes carved so far
 } icache;
 
+// Every inode below hint is in use, so ialloc starts scanning there.
+// nfree counts the frees, so that ialloc can tell whether one happened
+// while it was scanning.
+struct
+{
+    struct spinlock lock;
+    uint hint;
+    uint nfree;
+} ifree;
+
 void iinit()
 {
     int i = 0;
 
     initlock(&icache.lock, "icache");
-    for (i = 0; i < NINODE; i++)
+    initlock(&ifree.lock, "ifree");
+    ifree.hint = 1;
+    for (i = 0; i < NIHASH; i++)
+        icache.hash[i] = 0;
+    icache.free = 0;
+    icache.lru.prev = &icache.lru;
+    icache.lru.next = &icache.lru;
+}
+
+static int ihash(uint dev, uint inum) { return (dev * 31 + inum) % NIHASH; }
+
+// Carve a fresh page into inodes on the free list.
+// Returns 0 if out of memory. Caller holds icache.lock.
+static int igrow(void)
+{
+    struct inode *ip;
+    char *pa;
+
+    if ((pa = kalloc()) == 0)
+        return 0;
+    for (ip = (struct inode *)pa; ip + 1 <= (struct inode *)(pa + PGSIZE); ip++)
     {
-        initsleeplock(&icache.inode[i].lock, "inode");
+        initsleeplock(&ip->lock, "inode");
+        ip->ref = 0;
+        ip->next = icache.free;
+        icache.free = ip;
+        icache.n++;
     }
+    return 1;
+}
+
+static void lru_remove(struct inode *ip)
+{
+    ip->prev->next = ip->next;
+    ip->next->prev = ip->prev;
+}
+
+// Take an unused inode for iget, growing the cache or reclaiming the
+// least recently used idle inode. Caller holds icache.lock.
+static struct inode *ireclaim(void)
+{
+    struct inode *ip, **pp;
+
+    if (icache.free == 0 && icache.n < NINODE)
+        igrow();
+    if (icache.free == 0 && icache.lru.prev == &icache.lru && !igrow())
+        panic("iget: no inodes");
+
+    if ((ip = icache.free) != 0)
+    {
+        icache.free = ip->next;
+        return ip;
+    }
+
+    ip = icache.lru.prev;
+    lru_remove(ip);
+    for (pp = &icache.hash[ihash(ip->dev, ip->inum)]; *pp != ip;
+         pp = &(*pp)->hnext)
+        ;
+    *pp = ip->hnext;
+    return ip;
 }
 
 static struct inode *iget(uint dev, uint inum);
@@ -107,24 +269,43 @@ struct inode *ialloc(uint dev, short type)
 {
     struct buf *bp;
     struct dinode *dip;
+    uint start, nfree;
 
-    for (int inum = 1; inum < sb.ninodes; inum++)
-    {
-        bp = bread(dev, IBLOCK(inum, sb));
-        dip = (struct dinode *)bp->data + inum % IPB;
+    acquire(&ifree.lock);
+    start = ifree.hint;
+    nfree = ifree.nfree;
+    release(&ifree.lock);
 
-        if (dip->type == 0)
+    // if the hint was wrong after all, look again from inode 1 before
+    // giving up.
+    for (uint from = start;; from = 1)
+    {
+        for (int inum = from; inum < sb.ninodes; inum++)
         {
-            memset(dip, 0, sizeof(*dip));
-            dip->type = type;
-            dip->major = 0;
-            dip->minor = M_ALL;
-            dip->nlink = 1;
-            log_write(bp);
+            bp = bread(dev, IBLOCK(inum, sb));
+            dip = (struct dinode *)bp->data + inum % IPB;
+
+            if (dip->type == 0)
+            {
+                memset(dip, 0, sizeof(*dip));
+                dip->type = type;
+                dip->major = 0;
+                dip->minor = M_ALL;
+                dip->nlink = 1;
+                log_write(bp);
+                brelse(bp);
+                // only advance the hint if nothing was freed, and no one
+                // else moved it, while this scan ran.
+                acquire(&ifree.lock);
+                if (ifree.hint == start && ifree.nfree == nfree)
+                    ifree.hint = inum + 1;
+                release(&ifree.lock);
+                return iget(dev, inum);
+            }
             brelse(bp);
-            return iget(dev, inum);
         }
-        brelse(bp);
+        if (from == 1)
+            break;
     }
     panic("ialloc: no inodes");
 }
@@ -150,31 +331,29 @@ void iupdate(struct inode *ip)
 
 static struct inode *iget(uint dev, uint inum)
 {
-    struct inode *ip, *empty;
+    struct inode *ip;
+    int h = ihash(dev, inum);
 
     acquire(&icache.lock);
 
-    empty = 0;
-    for (ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++)
+    for (ip = icache.hash[h]; ip; ip = ip->hnext)
     {
-        if (ip->ref > 0 && ip->dev == dev && ip->inum == inum)
+        if (ip->dev == dev && ip->inum == inum)
         {
-            ip->ref++;
+            if (ip->ref++ == 0)
+                lru_remove(ip);
             release(&icache.lock);
             return ip;
         }
-        if (empty == 0 && ip->ref == 0)
-            empty = ip;
     }
 
-    if (empty == 0)
-        panic("iget: no inodes");
-
-    ip = empty;
+    ip = ireclaim();
     ip->dev = dev;
     ip->inum = inum;
     ip->ref = 1;
     ip->valid = 0;
+    ip->hnext = icache.hash[h];
+    icache.hash[h] = ip;
     release(&icache.lock);
 
     return ip;
@@ -242,12 +421,25 @@ void iput(struct inode *ip)
         iupdate(ip);
         ip->valid = 0;
 
+        acquire(&ifree.lock);
+        ifree.nfree++;
+        if (ip->inum < ifree.hint)
+            ifree.hint = ip->inum;
+        release(&ifree.lock);
+
         releasesleep(&ip->lock);
 
         acquire(&icache.lock);
     }
 
-    ip->ref--;
+    if (--ip->ref == 0)
+    {
+        // keep it cached, most recently used first.
+        ip->next = icache.lru.next;
+        ip->prev = &icache.lru;
+        icache.lru.next->prev = ip;
+        icache.lru.next = ip;
+    }
     release(&icache.lock);
 }
 
@@ -257,16 +449,96 @@ void iunlockput(struct inode *ip)
     iput(ip);
 }
 
-uint bmap(struct inode *ip, uint bn)
+static int isextent(struct inode *ip)
+{
+    return ip->type == T_FILE && ip->major == I_EXTENT;
+}
+
+// bmapx for an extent-mapped inode, see I_EXTENT in fs.h.
+static uint emap(struct inode *ip, uint bn, int alloc)
+{
+    uint *e = ip->addrs, base = 0, near = ghome(ip), addr = 0, ind, *a;
+    struct buf *bp;
+    int i;
+
+    for (i = 0; i < NEXTENT && e[2 * i + 1]; i++)
+    {
+        if (bn < base + e[2 * i + 1])
+            return e[2 * i] + bn - base;
+        base += e[2 * i + 1];
+        near = e[2 * i] + e[2 * i + 1];
+    }
+    if (ip->addrs[NDIRECT] == 0)
+    {
+        if (!alloc)
+            return 0;
+        if (bn == base)
+        {
+            // grow the last run if the next block is free,
+            // otherwise start a new one.
+            addr = balloc(ip->dev, near);
+            if (i > 0 && addr == near)
+            {
+                e[2 * i - 1]++;
+                return addr;
+            }
+            if (i < NEXTENT)
+            {
+                e[2 * i] = addr;
+                e[2 * i + 1] = 1;
+                return addr;
+            }
+            // the runs are full: addr goes in the double-indirect tree.
+        }
+        ip->addrs[NDIRECT] = balloc(ip->dev, near);
+    }
+
+    bn -= base;
+    if (bn >= MAXEXTFILE)
+        panic("emap: out of range");
+
+    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+    a = (uint *)bp->data;
+    if ((ind = a[bn / NINDIRECT]) == 0 && alloc)
+    {
+        ind = a[bn / NINDIRECT] = balloc(ip->dev, near);
+        log_write(bp);
+    }
+    brelse(bp);
+    if (ind == 0)
+        return 0;
+
+    bp = bread(ip->dev, ind);
+    a = (uint *)bp->data;
+    if (a[bn % NINDIRECT] == 0 && alloc)
+    {
+        if (addr == 0)
+            addr = balloc(ip->dev, bn % NINDIRECT ? a[bn % NINDIRECT - 1] + 1
+                                                  : near);
+        a[bn % NINDIRECT] = addr;
+        log_write(bp);
+    }
+    addr = a[bn % NINDIRECT];
+    brelse(bp);
+    return addr;
+}
+
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, allocate one if alloc is set,
+// otherwise return 0.
+static uint bmapx(struct inode *ip, uint bn, int alloc)
 {
     uint addr, *a;
     struct buf *bp;
 
+    if (isextent(ip))
+        return emap(ip, bn, alloc);
+
     if (bn < NDIRECT)
     {
-        if ((addr = ip->addrs[bn]) == 0)
+        if ((addr = ip->addrs[bn]) == 0 && alloc)
         {
-            addr = balloc(ip->dev);
+            addr = balloc(ip->dev, ghome(ip));
             if (addr == 0)
                 panic("bmap: balloc failed");
             ip->addrs[bn] = addr;
@@ -278,7 +550,9 @@ uint bmap(struct inode *ip, uint bn)
     {
         if ((addr = ip->addrs[NDIRECT]) == 0)
         {
-            addr = balloc(ip->dev);
+            if (!alloc)
+                return 0;
+            addr = balloc(ip->dev, ghome(ip));
             if (addr == 0)
                 panic("bmap: balloc failed for indirect block");
             ip->addrs[NDIRECT] = addr;
@@ -289,9 +563,9 @@ uint bmap(struct inode *ip, uint bn)
 
         uint t_addr = a[bn];
 
-        if (t_addr == 0)
+        if (t_addr == 0 && alloc)
         {
-            t_addr = balloc(ip->dev);
+            t_addr = balloc(ip->dev, ghome(ip));
             if (t_addr == 0)
                 panic("bmap: balloc failed for data block via indirect");
             a[bn] = t_addr;
@@ -307,12 +581,155 @@ uint bmap(struct inode *ip, uint bn)
     panic("bmap: out of range");
 }
 
+uint bmap(struct inode *ip, uint bn) { return bmapx(ip, bn, 1); }
+
+// Extents being collected by iextents.
+struct extlist
+{
+    struct fextent *ext;
+    int n, max;
+    uint start;
+};
+
+// Add len blocks from lbn at disk block pbn to l, merging with the last
+// extent when they continue it. Returns 0 once l is full.
+static int addrun(struct extlist *l, uint lbn, uint pbn, uint len)
+{
+    struct fextent *last;
+
+    if (pbn == 0 || lbn + len <= l->start)
+        return 1;
+    if (lbn < l->start)
+    {
+        pbn += l->start - lbn;
+        len -= l->start - lbn;
+        lbn = l->start;
+    }
+    if (l->n > 0)
+    {
+        last = &l->ext[l->n - 1];
+        if (last->lbn + last->len == lbn && last->pbn + last->len == pbn)
+        {
+            last->len += len;
+            return 1;
+        }
+    }
+    if (l->n == l->max)
+        return 0;
+    l->ext[l->n].lbn = lbn;
+    l->ext[l->n].pbn = pbn;
+    l->ext[l->n].len = len;
+    l->n++;
+    return 1;
+}
+
+// Add the blocks listed in indirect block ind, the first of which is
+// file block lbn.
+static int addind(struct extlist *l, struct inode *ip, uint ind, uint lbn)
+{
+    struct buf *bp;
+    uint *a;
+    int more = 1;
+
+    if (ind == 0 || lbn + NINDIRECT <= l->start)
+        return 1;
+    bp = bread(ip->dev, ind);
+    a = (uint *)bp->data;
+    for (int j = 0; more && j < NINDIRECT; j++)
+        more = addrun(l, lbn + j, a[j], 1);
+    brelse(bp);
+    return more;
+}
+
+// Fill ext[0..max-1] with the extents of ip's blocks from file block
+// start on, in file order, reading each indirect block once. Holes are
+// left out. Returns the number of extents; if it is max, there may be
+// more after the last. Caller must hold ip->lock.
+int iextents(struct inode *ip, uint start, struct fextent *ext, int max)
+{
+    struct extlist l = {ext, 0, max, start};
+    struct buf *bp;
+    uint *a, base = 0;
+    int more = 1, i;
+
+    if (isextent(ip))
+    {
+        for (i = 0; more && i < NEXTENT && ip->addrs[2 * i + 1]; i++)
+        {
+            more = addrun(&l, base, ip->addrs[2 * i], ip->addrs[2 * i + 1]);
+            base += ip->addrs[2 * i + 1];
+        }
+        if (more && ip->addrs[NDIRECT])
+        {
+            bp = bread(ip->dev, ip->addrs[NDIRECT]);
+            a = (uint *)bp->data;
+            for (i = 0; more && i < NINDIRECT; i++)
+                more = addind(&l, ip, a[i], base + i * NINDIRECT);
+            brelse(bp);
+        }
+        return l.n;
+    }
+
+    for (i = 0; more && i < NDIRECT; i++)
+        more = addrun(&l, i, ip->addrs[i], 1);
+    if (more)
+        addind(&l, ip, ip->addrs[NDIRECT], NDIRECT);
+    return l.n;
+}
+
+// Free the blocks of an extent-mapped inode.
+static void etrunc(struct inode *ip)
+{
+    int i, j;
+    struct buf *bp;
+    uint *a;
+
+    for (i = 0; i < NEXTENT; i++)
+    {
+        for (j = 0; j < ip->addrs[2 * i + 1]; j++)
+            bfree(ip->dev, ip->addrs[2 * i] + j);
+        ip->addrs[2 * i] = ip->addrs[2 * i + 1] = 0;
+    }
+
+    if (ip->addrs[NDIRECT])
+    {
+        bp = bread(ip->dev, ip->addrs[NDIRECT]);
+        a = (uint *)bp->data;
+        for (i = 0; i < NINDIRECT; i++)
+        {
+            if (a[i])
+            {
+                struct buf *ibp = bread(ip->dev, a[i]);
+                uint *ia = (uint *)ibp->data;
+                for (j = 0; j < NINDIRECT; j++)
+                {
+                    if (ia[j])
+                        bfree(ip->dev, ia[j]);
+                }
+                brelse(ibp);
+                bfree(ip->dev, a[i]);
+            }
+        }
+        brelse(bp);
+        bfree(ip->dev, ip->addrs[NDIRECT]);
+        ip->addrs[NDIRECT] = 0;
+    }
+}
+
 void itrunc(struct inode *ip)
 {
     int i, j;
     struct buf *bp;
     uint *a;
 
+    if (isextent(ip))
+    {
+        etrunc(ip);
+        ip->size = 0;
+        iupdate(ip);
+        return;
+    }
+
     for (i = 0; i < NDIRECT; i++)
     {
         if (ip->addrs[i])
@@ -350,9 +767,11 @@ void stati(struct inode *ip, struct stat *st)
     st->mode = ip->minor;
 }
 
+static uchar zeroes[BSIZE];
+
 int readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-    uint tot, m;
+    uint tot, m, addr;
     struct buf *bp;
 
     if (!(ip->type == T_FILE || ip->type == T_SYMLINK || ip->type == T_DIR))
@@ -365,8 +784,15 @@ int readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 
     for (tot = 0; tot < n; tot += m, off += m, dst += m)
     {
-        bp = bread(ip->dev, bmap(ip, off / BSIZE));
         m = min(n - tot, BSIZE - off % BSIZE);
+        if ((addr = bmapx(ip, off / BSIZE, 0)) == 0)
+        {
+            // a hole, such as an unused bucket of a hashed directory.
+            if (either_copyout(user_dst, dst, zeroes, m) == -1)
+                break;
+            continue;
+        }
+        bp = bread(ip->dev, addr);
         if (either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1)
         {
             brelse(bp);
@@ -384,7 +810,7 @@ int writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 
     if (off > ip->size || off + n < off)
         return -1;
-    if (off + n > MAXFILE * BSIZE)
+    if (off + n > (isextent(ip) ? MAXEXTFILE : MAXFILE) * BSIZE)
         return -1;
 
     for (tot = 0; tot < n; tot += m, off += m, src += m)
@@ -415,6 +841,110 @@ int writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 
 int namecmp(const char *s, const char *t) { return strncmp(s, t, DIRSIZ); }
 
+// Hashed directories, see struct dirhdr in fs.h.
+// "." and ".." always live in bucket 0, so a new directory only
+// allocates its first block.
+
+static uint dirbucket(struct inode *dp, char *name)
+{
+    if (namecmp(name, ".") == 0 || namecmp(name, "..") == 0)
+        return 0;
+    return dirhash(name) % dp->major;
+}
+
+static void readhdr(struct inode *dp, uint b, struct dirhdr *hdr)
+{
+    if (readi(dp, 0, (uint64)hdr, b * BSIZE, sizeof(*hdr)) != sizeof(*hdr))
+        panic("readhdr");
+}
+
+static void writehdr(struct inode *dp, uint b, struct dirhdr *hdr)
+{
+    if (writei(dp, 0, (uint64)hdr, b * BSIZE, sizeof(*hdr)) != sizeof(*hdr))
+        panic("writehdr");
+}
+
+// Scan bucket b of hashed directory dp for name, or for a free slot
+// if name is 0, reading the bucket's block once. Returns the slot's
+// byte offset in dp, or 0 (the offset of a header) if there is none.
+static uint bucketscan(struct inode *dp, uint b, char *name, uint *inum)
+{
+    struct buf *bp;
+    struct dirent *de;
+    uint addr, off = 0;
+
+    if ((addr = bmapx(dp, b, 0)) == 0)
+        return name ? 0 : b * BSIZE + sizeof(*de);
+
+    bp = bread(dp->dev, addr);
+    de = (struct dirent *)bp->data;
+    for (int i = 1; i < DPB; i++)
+    {
+        if (name == 0 ? de[i].inum == 0
+                      : de[i].inum != 0 && namecmp(name, de[i].name) == 0)
+        {
+            off = b * BSIZE + i * sizeof(*de);
+            if (inum)
+                *inum = de[i].inum;
+            break;
+        }
+    }
+    brelse(bp);
+    return off;
+}
+
+static struct inode *hdirlookup(struct inode *dp, char *name, uint *poff)
+{
+    uint h = dirbucket(dp, name), off, inum;
+    struct dirhdr hdr;
+
+    readhdr(dp, h, &hdr);
+    for (uint i = 0; i <= hdr.probe && i < dp->major; i++)
+    {
+        if ((off = bucketscan(dp, (h + i) % dp->major, name, &inum)) != 0)
+        {
+            if (poff)
+                *poff = off;
+            return iget(dp->dev, inum);
+        }
+    }
+    return 0;
+}
+
+static int hdirlink(struct inode *dp, char *name, uint inum)
+{
+    uint h = dirbucket(dp, name), off;
+    struct dirent de;
+    struct dirhdr hdr;
+
+    for (uint i = 0; i < dp->major; i++)
+    {
+        if ((off = bucketscan(dp, (h + i) % dp->major, 0, 0)) == 0)
+            continue;
+
+        memset(&de, 0, sizeof(de));
+        strncpy(de.name, name, DIRSIZ);
+        de.inum = inum;
+        if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+            panic("dirlink");
+
+        readhdr(dp, h, &hdr);
+        if (i > hdr.probe)
+        {
+            hdr.probe = i;
+            writehdr(dp, h, &hdr);
+        }
+        if (namecmp(name, ".") != 0 && namecmp(name, "..") != 0)
+        {
+            readhdr(dp, 0, &hdr);
+            hdr.nentries++;
+            writehdr(dp, 0, &hdr);
+        }
+        return 0;
+    }
+    return -1;
+}
+
 struct inode *dirlookup(struct inode *dp, char *name, uint *poff)
 {
     uint off, inum;
@@ -422,6 +952,8 @@ struct inode *dirlookup(struct inode *dp, char *name, uint *poff)
 
     if (dp->type != T_DIR)
         panic("dirlookup not DIR");
+    if (dp->major)
+        return hdirlookup(dp, name, poff);
 
     for (off = 0; off < dp->size; off += sizeof(de))
     {
@@ -453,6 +985,8 @@ int dirlink(struct inode *dp, char *name, uint inum)
         iput(ip);
         return -1;
     }
+    if (dp->major)
+        return hdirlink(dp, name, inum);
 
     for (off = 0; off < dp->size; off += sizeof(de))
     {
@@ -470,6 +1004,24 @@ int dirlink(struct inode *dp, char *name, uint inum)
     return 0;
 }
 
+// Clear the entry for name that dirlookup found at offset off in dp.
+void dirunlink(struct inode *dp, char *name, uint off)
+{
+    struct dirent de;
+    struct dirhdr hdr;
+
+    memset(&de, 0, sizeof(de));
+    if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirunlink");
+
+    if (dp->major && namecmp(name, ".") != 0 && namecmp(name, "..") != 0)
+    {
+        readhdr(dp, 0, &hdr);
+        hdr.nentries--;
+        writehdr(dp, 0, &hdr);
+    }
+}
+
 static char *skipelem(char *path, char *name)
 {
     char *s;
@@ -495,12 +1047,17 @@ static char *skipelem(char *path, char *name)
     return path;
 }
 
-struct inode *namex(char *path, int nameiparent, char *name)
+// Look up and return the inode for a path name. Relative paths start
+// at directory dp, or at the current directory if dp is 0.
+static struct inode *namexat(struct inode *dp, char *path, int nameiparent,
+                             char *name)
 {
     struct inode *ip, *next;
 
     if (*path == '/')
         ip = iget(ROOTDEV, ROOTINO);
+    else if (dp)
+        ip = idup(dp);
     else
         ip = idup(myproc()->cwd);
 
@@ -567,7 +1124,7 @@ struct inode *namex(char *path, int nameiparent, char *name)
 
             iput(ip);
 
-            return namex(newpath, nameiparent, name);
+            return namexat(0, newpath, nameiparent, name);
         }
 
         iunlock(ip);
@@ -580,6 +1137,11 @@ struct inode *namex(char *path, int nameiparent, char *name)
     return ip;
 }
 
+struct inode *namex(char *path, int nameiparent, char *name)
+{
+    return namexat(0, path, nameiparent, name);
+}
+
 struct inode *namei(char *path)
 {
     char name[DIRSIZ];
@@ -613,3 +1175,11 @@ struct inode *nameiparent(char *path, char *name)
 {
     return namex(path, 1, name);
 }
+
+// Resolve path relative to directory dp, as openat/fstatat do.
+// A single-component name costs one dirlookup in dp.
+struct inode *nameiat(struct inode *dp, char *path)
+{
+    char name[DIRSIZ];
+    return namexat(dp, path, 0, name);
+}
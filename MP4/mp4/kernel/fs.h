@@ -6,7 +6,7 @@
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
-//                                          free bit map | data blocks]
+//                      free bit map | RAID-1 write-intent map | data blocks]
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
@@ -20,6 +20,13 @@ struct superblock
     uint logstart;   // Block number of first log block
     uint inodestart; // Block number of first inode block
     uint bmapstart;  // Block number of first free map block
+    uint raidmap;    // First block of the RAID-1 write-intent map
+    uint layout;     // Block device layout, see bdev.h
+    uint ndisk;      // Number of disks it uses
+    uint nmember;    // Number of members it spreads blocks over
+    uint msize;      // Blocks per member
+    uint chunk;      // Blocks per stripe chunk (RAID-0 and RAID-10)
+    uint csumstart;  // Block number of first checksum block, or 0
 };
 
 #define FSMAGIC 0x10203040
@@ -28,11 +35,20 @@ struct superblock
 #define NINDIRECT (BSIZE / sizeof(uint))
 #define MAXFILE (NDIRECT + NINDIRECT)
 
+// A T_FILE whose major is I_EXTENT maps its blocks with extents:
+// addrs[] holds NEXTENT (start, length) runs of disk blocks that cover
+// the file's first blocks in order. Once the runs are used up, the rest
+// of the file is mapped through a double-indirect block in
+// addrs[NDIRECT], so such a file may grow to MAXEXTFILE blocks.
+#define I_EXTENT 1
+#define NEXTENT (NDIRECT / 2)
+#define MAXEXTFILE (NINDIRECT * NINDIRECT)
+
 // On-disk inode structure
 struct dinode
 {
     short type;              // File type
-    short major;             // Major device number (T_DEVICE only)
+    short major;             // Major device number (T_DEVICE), or mode
     short minor;             // Minor device number (T_DEVICE only)
     short nlink;             // Number of links to inode in file system
     uint size;               // Size of file (bytes)
@@ -59,3 +75,30 @@ struct dirent
     ushort inum;
     char name[DIRSIZ];
 };
+
+// A directory whose major field is non-zero is hashed: its first major
+// blocks are buckets, and a name lives in bucket dirhash(name) % major,
+// or in one of the next probe buckets if that one was full. Bucket
+// blocks are allocated on first use, so unused buckets are holes.
+// Slot 0 of every bucket is a struct dirhdr; it reads as a free dirent,
+// so programs that scan a directory as plain dirents skip it.
+#define DPB (BSIZE / sizeof(struct dirent)) // dirents per block
+#define MAXDIRBUCKET 256                    // buckets must fit in MAXFILE
+
+struct dirhdr
+{
+    ushort zero;   // always 0, where a dirent keeps its inum
+    ushort probe;  // furthest bucket past this one holding its names
+    uint nentries; // bucket 0 only: entries other than "." and ".."
+    uint pad[2];
+};
+
+// FNV-1a over the (at most DIRSIZ byte) name.
+static inline uint dirhash(const char *name)
+{
+    uint h = 2166136261U;
+
+    for (int i = 0; i < DIRSIZ && name[i]; i++)
+        h = (h ^ (uchar)name[i]) * 16777619U;
+    return h;
+}
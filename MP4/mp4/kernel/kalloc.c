@@ -19,10 +19,16 @@ struct run
     struct run *next;
 };
 
+// Pages can have more than one owner once fork shares user pages
+// copy-on-write. kalloc gives a page one reference, kref adds one, and
+// kfree frees the page when it drops the last.
+#define PA2REF(pa) (((uint64)(pa)-KERNBASE) / PGSIZE)
+
 struct
 {
     struct spinlock lock;
     struct run *freelist;
+    ushort ref[PA2REF(PHYSTOP)]; // protected by lock
 } kmem;
 
 void kinit()
@@ -36,12 +42,15 @@ void freerange(void *pa_start, void *pa_end)
     char *p;
     p = (char *)PGROUNDUP((uint64)pa_start);
     for (; p + PGSIZE <= (char *)pa_end; p += PGSIZE)
+    {
+        kmem.ref[PA2REF(p)] = 1;
         kfree(p);
+    }
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
+// Drop a reference to the page of physical memory pointed at by v,
+// and free it if that was the last one. The page normally should
+// have been returned by a call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
 void kfree(void *pa)
 {
@@ -50,6 +59,16 @@ void kfree(void *pa)
     if (((uint64)pa % PGSIZE) != 0 || (char *)pa < end || (uint64)pa >= PHYSTOP)
         panic("kfree");
 
+    acquire(&kmem.lock);
+    if (kmem.ref[PA2REF(pa)] == 0)
+        panic("kfree: free page");
+    if (--kmem.ref[PA2REF(pa)] > 0)
+    {
+        release(&kmem.lock);
+        return;
+    }
+    release(&kmem.lock);
+
     // Fill with junk to catch dangling refs.
     memset(pa, 1, PGSIZE);
 
@@ -71,10 +90,34 @@ void *kalloc(void)
     acquire(&kmem.lock);
     r = kmem.freelist;
     if (r)
+    {
         kmem.freelist = r->next;
+        kmem.ref[PA2REF(r)] = 1;
+    }
     release(&kmem.lock);
 
     if (r)
         memset((char *)r, 5, PGSIZE); // fill with junk
     return (void *)r;
 }
+
+// Add a reference to page pa, which is allocated.
+void kref(void *pa)
+{
+    acquire(&kmem.lock);
+    if (kmem.ref[PA2REF(pa)] == 0)
+        panic("kref");
+    kmem.ref[PA2REF(pa)]++;
+    release(&kmem.lock);
+}
+
+// How many references does page pa have?
+int krefcnt(void *pa)
+{
+    int n;
+
+    acquire(&kmem.lock);
+    n = kmem.ref[PA2REF(pa)];
+    release(&kmem.lock);
+    return n;
+}
@@ -20,14 +20,19 @@ void main()
         kvminit();          // create kernel page table
         kvminithart();      // turn on paging
         procinit();         // process table
+        timerqinit();       // deadline timers
         trapinit();         // trap vectors
         trapinithart();     // install kernel trap vector
         plicinit();         // set up interrupt controller
         plicinithart();     // ask PLIC for device interrupts
         binit();            // buffer cache
+        bdevinit();         // block device layout
+        csuminit();         // block checksums
         iinit();            // inode cache
         fileinit();         // file table
+        shminit();          // shared memory segments
         virtio_disk_init(); // emulated hard disk
+        raidinit();         // RAID-1 resync state
         userinit();         // first user process
         __sync_synchronize();
         started = 1;
@@ -21,9 +21,10 @@
 #define UART0 0x10000000L
 #define UART0_IRQ 10
 
-// virtio mmio interface
+// virtio mmio interface; qemu's virtio-mmio-bus.i is at VIRTIO(i).
 #define VIRTIO0 0x10001000
 #define VIRTIO0_IRQ 1
+#define VIRTIO(i) (VIRTIO0 + (uint64)(i) * 0x1000)
 
 // local interrupt controller, which contains the timer.
 #define CLINT 0x2000000L
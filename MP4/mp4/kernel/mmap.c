@@ -0,0 +1,448 @@
+// Memory-mapped files.
+//
+// mmap records a region of a file in one of the process's VMAs and maps
+// nothing. Each page is read from the file on its first touch (see
+// vma_fault), so a process that maps a large file and looks at a little
+// of it reads only that little. munmap and exit write the pages of a
+// MAP_SHARED mapping back to the file, if they were written.
+//
+// Pages of a writable shared mapping are mapped read-only until their
+// first store, which faults again and marks the PTE dirty, so only
+// dirty pages are written back.
+//
+// copyin and copyout do not read file pages in, since their callers may
+// hold inode locks. System calls that copy to or from user memory under
+// such a lock prefault the range first (vma_prefault); others fail on a
+// page of a mapped file that has not been touched yet.
+//
+// A VMA can map a shared memory segment (shm.c) instead of a file. Its
+// pages are the segment's, so they need no reading or writing back, and
+// every process that maps the segment sees the same memory.
+//
+// The VMAs are private to the process, like p->ofile, so they need no
+// lock. They live above the heap, placed down from the trapframe.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+
+// The VMA of p that contains va, or 0.
+static struct vma *vmafind(struct proc *p, uint64 va)
+{
+    for (int i = 0; i < NVMA; i++)
+    {
+        struct vma *v = &p->vmas[i];
+        if (v->addr != 0 && va >= v->addr && va < v->addr + v->len)
+            return v;
+    }
+    return 0;
+}
+
+// Does [start, end) overlap one of p's VMAs?
+int vma_overlap(struct proc *p, uint64 start, uint64 end)
+{
+    for (int i = 0; i < NVMA; i++)
+    {
+        struct vma *v = &p->vmas[i];
+        if (v->addr != 0 && start < v->addr + v->len && v->addr < end)
+            return 1;
+    }
+    return 0;
+}
+
+// A free VMA of p, placed at the highest gap below the trapframe and
+// above the heap that fits len bytes, or 0.
+static struct vma *vmaalloc(struct proc *p, uint64 len)
+{
+    struct vma *v = 0;
+    uint64 a;
+    int i;
+
+    for (i = 0; i < NVMA; i++)
+    {
+        if (p->vmas[i].addr == 0)
+        {
+            v = &p->vmas[i];
+            break;
+        }
+    }
+    if (v == 0)
+        return 0;
+
+    a = TRAPFRAME - len;
+    for (i = 0; i < NVMA; i++)
+    {
+        struct vma *u = &p->vmas[i];
+        if (u->addr != 0 && a < u->addr + u->len && u->addr < a + len)
+        {
+            a = u->addr - len;
+            i = -1; // start over against the lower address
+        }
+        if (a < PGROUNDUP(p->sz) || a > TRAPFRAME)
+            return 0;
+    }
+    v->addr = a;
+    v->len = len;
+    return v;
+}
+
+// Map len bytes of f from offset off. Returns the address, or -1.
+uint64 mmap(struct file *f, uint64 len, int prot, int flags, uint off)
+{
+    struct vma *v;
+
+    if (len == 0 || off % PGSIZE != 0 || f->type != FD_INODE)
+        return -1;
+    if (flags != MAP_SHARED && flags != MAP_PRIVATE)
+        return -1;
+    if ((prot & PROT_READ) && !f->readable)
+        return -1;
+    // a private mapping's writes never reach the file.
+    if ((prot & PROT_WRITE) && flags == MAP_SHARED && !f->writable)
+        return -1;
+    if ((v = vmaalloc(myproc(), PGROUNDUP(len))) == 0)
+        return -1;
+    v->prot = prot;
+    v->flags = flags;
+    v->f = filedup(f);
+    v->shm = 0;
+    v->off = off;
+    return v->addr;
+}
+
+// Map all len bytes of segment s, read-write. The mapping takes over
+// the caller's reference to s. Returns the address, or -1.
+uint64 mmapshm(struct shm *s, uint64 len)
+{
+    struct vma *v;
+
+    if ((v = vmaalloc(myproc(), len)) == 0)
+        return -1;
+    v->prot = PROT_READ | PROT_WRITE;
+    v->flags = MAP_SHARED;
+    v->f = 0;
+    v->shm = s;
+    v->off = 0;
+    return v->addr;
+}
+
+// The VMA's own reference to its file or segment.
+static void vmadup(struct vma *v)
+{
+    if (v->f)
+        filedup(v->f);
+    else
+        shmdup(v->shm);
+}
+
+static void vmaput(struct vma *v)
+{
+    if (v->f)
+        fileclose(v->f);
+    else
+        shmput(v->shm);
+}
+
+// Write the dirty pages of shared mapping v in [va, va+len) back to its
+// file, but not past the end of the file, which mmap does not extend.
+static void writeback(struct proc *p, struct vma *v, uint64 va, uint64 len)
+{
+    struct inode *ip = v->f->ip;
+    uint64 a;
+    uint off, n;
+    pte_t *pte;
+
+    for (a = va; a < va + len; a += PGSIZE)
+    {
+        if ((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0 ||
+            (*pte & PTE_D) == 0)
+            continue;
+        off = v->off + (a - v->addr);
+
+        // one page is at most a filewrite-sized transaction.
+        begin_op();
+        ilock(ip);
+        if (off < ip->size)
+        {
+            n = ip->size - off;
+            if (n > PGSIZE)
+                n = PGSIZE;
+            writei(ip, 0, PTE2PA(*pte), off, n);
+        }
+        iunlock(ip);
+        end_op();
+    }
+}
+
+// Unmap [va, va+len) of v, which must be page-aligned and within it.
+static void vmacut(struct proc *p, struct vma *v, uint64 va, uint64 len)
+{
+    uint64 a;
+    pte_t *pte;
+
+    if (v->f && v->flags == MAP_SHARED)
+        writeback(p, v, va, len);
+    for (a = va; a < va + len; a += PGSIZE)
+    {
+        if ((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+            continue;
+        kfree((void *)PTE2PA(*pte));
+        *pte = 0;
+    }
+    sfence_vma();
+
+    if (va == v->addr && len == v->len)
+    {
+        vmaput(v);
+        v->addr = 0;
+    }
+    else if (va == v->addr)
+    {
+        v->addr += len;
+        v->off += len;
+        v->len -= len;
+    }
+    else if (va + len == v->addr + v->len)
+    {
+        v->len -= len;
+    }
+    else
+    {
+        // a hole in the middle leaves two VMAs.
+        struct vma *u = 0;
+        for (int i = 0; i < NVMA; i++)
+        {
+            if (p->vmas[i].addr == 0)
+            {
+                u = &p->vmas[i];
+                break;
+            }
+        }
+        if (u == 0)
+            panic("vmacut"); // munmap checked for a free slot
+        *u = *v;
+        u->addr = va + len;
+        u->off = v->off + (u->addr - v->addr);
+        u->len = v->addr + v->len - u->addr;
+        vmadup(u);
+        v->len = va - v->addr;
+    }
+}
+
+// Unmap [addr, addr+len), which may cover parts of several mappings.
+// Returns -1 if addr is not page-aligned, or no VMA slot is free for
+// a hole punched in the middle of a mapping.
+int munmap(uint64 addr, uint64 len)
+{
+    struct proc *p = myproc();
+    uint64 end, s, e;
+    int i, nfree = 0, nsplit = 0;
+
+    if (addr % PGSIZE != 0 || len == 0 || addr + len < addr)
+        return -1;
+    end = PGROUNDUP(addr + len);
+
+    for (i = 0; i < NVMA; i++)
+    {
+        struct vma *v = &p->vmas[i];
+        if (v->addr == 0)
+            nfree++;
+        else if (addr > v->addr && end < v->addr + v->len)
+            nsplit++;
+    }
+    if (nsplit > nfree)
+        return -1;
+
+    for (i = 0; i < NVMA; i++)
+    {
+        struct vma *v = &p->vmas[i];
+        if (v->addr == 0 || end <= v->addr || addr >= v->addr + v->len)
+            continue;
+        s = addr > v->addr ? addr : v->addr;
+        e = end < v->addr + v->len ? end : v->addr + v->len;
+        vmacut(p, v, s, e - s);
+    }
+    return 0;
+}
+
+// Unmap all of p's mappings, for exit and exec.
+void vma_unmapall(struct proc *p)
+{
+    for (int i = 0; i < NVMA; i++)
+    {
+        struct vma *v = &p->vmas[i];
+        if (v->addr != 0)
+            vmacut(p, v, v->addr, v->len);
+    }
+}
+
+// fork gives the child the parent's mappings, and the pages the parent
+// has mapped in them: a shared mapping's pages stay the same memory in
+// both, and a writable private mapping's become copy-on-write in both,
+// as uvmcopy does for the rest of memory. Pages the parent has not
+// touched are read from the file by whichever process touches them.
+// Returns -1, with nothing mapped in the child, if memory is short.
+int vma_fork(struct proc *p, struct proc *np)
+{
+    struct vma *v;
+    uint64 a, pa;
+    pte_t *pte;
+    int i;
+
+    for (i = 0; i < NVMA; i++)
+    {
+        v = &p->vmas[i];
+        if (v->addr == 0)
+            continue;
+        for (a = v->addr; a < v->addr + v->len; a += PGSIZE)
+        {
+            if ((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+                continue;
+            if (v->flags == MAP_PRIVATE && (v->prot & PROT_WRITE))
+                *pte = (*pte & ~PTE_W) | PTE_COW;
+            pa = PTE2PA(*pte);
+            if (mappages(np->pagetable, a, PGSIZE, pa, PTE_FLAGS(*pte)) != 0)
+                goto err;
+            kref((void *)pa);
+        }
+    }
+
+    for (i = 0; i < NVMA; i++)
+    {
+        np->vmas[i] = p->vmas[i];
+        if (p->vmas[i].addr != 0)
+            vmadup(&np->vmas[i]);
+    }
+    return 0;
+
+err:
+    // drop what the child got; the parent's pages stay copy-on-write,
+    // which uvmcow undoes without a copy once they are its alone.
+    for (i = 0; i < NVMA; i++)
+    {
+        v = &p->vmas[i];
+        if (v->addr == 0)
+            continue;
+        for (a = v->addr; a < v->addr + v->len; a += PGSIZE)
+        {
+            if ((pte = walk(np->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+                continue;
+            kfree((void *)PTE2PA(*pte));
+            *pte = 0;
+        }
+    }
+    return -1;
+}
+
+// The kernel address of user address va in a shared memory segment
+// of the current process, or 0 if it is not in one.
+uint64 vma_shmpa(uint64 va)
+{
+    struct vma *v = vmafind(myproc(), va);
+    uint64 off;
+
+    if (v == 0 || v->shm == 0)
+        return 0;
+    off = v->off + (va - v->addr);
+    return (uint64)shmpage(v->shm, off / PGSIZE) + off % PGSIZE;
+}
+
+// A fault at va in the current process, a store if write is set. Read
+// the page in from the file if it is in a mapping that allows the
+// access, or mark it dirty if it is the first store to a page mapped
+// in read-only. Returns -1 if there is no such mapping.
+//
+// Reading the file takes its inode lock, so it is done only if canread
+// is set. copyin and copyout run with inode and buffer locks held, so
+// they leave it unset; their callers use vma_prefault beforehand.
+int vma_fault(uint64 va, int write, int canread)
+{
+    struct proc *p = myproc();
+    struct vma *v;
+    pte_t *pte;
+    char *mem;
+    int perm;
+
+    if ((v = vmafind(p, va)) == 0)
+        return -1;
+    if (!(v->prot & (write ? PROT_WRITE : PROT_READ)))
+        return -1;
+    va = PGROUNDDOWN(va);
+
+    if ((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V))
+    {
+        if (!write || (*pte & PTE_W))
+            return -1;
+        *pte |= PTE_W | PTE_D;
+        sfence_vma();
+        return 0;
+    }
+
+    if (v->shm)
+    {
+        mem = shmpage(v->shm, (v->off + (va - v->addr)) / PGSIZE);
+        kref(mem);
+        if (mappages(p->pagetable, va, PGSIZE, (uint64)mem,
+                     PTE_U | PTE_R | PTE_W | PTE_A | PTE_D) != 0)
+        {
+            kfree(mem);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!canread)
+        return -1;
+
+    if ((mem = kalloc()) == 0)
+        return -1;
+    memset(mem, 0, PGSIZE);
+    ilock(v->f->ip);
+    readi(v->f->ip, 0, (uint64)mem, v->off + (va - v->addr), PGSIZE);
+    iunlock(v->f->ip);
+
+    // set A and D here, so that hardware that will not set them itself
+    // does not fault on them.
+    perm = PTE_U | PTE_R | PTE_A;
+    if (write)
+        perm |= PTE_W | PTE_D;
+    if (mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0)
+    {
+        kfree(mem);
+        return -1;
+    }
+    return 0;
+}
+
+// Read in the mapped pages of [va, va+n) that are not yet, for a caller
+// about to copy to or from them, which vma_fault cannot do then. Call it
+// before taking any lock. Failures are left for the copy to find.
+void vma_prefault(uint64 va, uint64 n, int write)
+{
+    struct proc *p = myproc();
+    uint64 a, s, e;
+    pte_t *pte;
+
+    for (int i = 0; i < NVMA; i++)
+    {
+        struct vma *v = &p->vmas[i];
+        if (v->addr == 0)
+            continue;
+        s = PGROUNDDOWN(va) > v->addr ? PGROUNDDOWN(va) : v->addr;
+        e = va + n < v->addr + v->len ? va + n : v->addr + v->len;
+        for (a = s; a < e; a += PGSIZE)
+        {
+            if ((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0 ||
+                (write && (*pte & PTE_W) == 0))
+                vma_fault(a, write, 1);
+        }
+    }
+}
@@ -1,11 +1,19 @@
 #define NPROC 64                  // maximum number of processes
 #define NCPU 8                    // maximum number of CPUs
 #define NOFILE 16                 // open files per process
+#define NVMA 16                   // mapped file regions per process
+#define NSHM 16                   // shared memory segments per system
+#define SHMPAGES 64               // pages per shared memory segment, at most
 #define NFILE 100                 // open files per system
-#define NINODE 50                 // maximum number of active i-nodes
+#define NINODE 50                 // i-nodes cached before idle ones are reused
 #define NDEV 10                   // maximum major device number
 #define ROOTDEV 1                 // device number of file system root disk
+#define NDISK 4                   // maximum number of virtio disks
+#define TICKCYCLES 1000000        // timer cycles per tick, about 1/10th second in qemu
+#define USCYCLES 10               // timer cycles per microsecond
+#define HZ (1000000 * USCYCLES / TICKCYCLES) // ticks per second
 #define MAXARG 32                 // max exec arguments
+#define FAULTAROUND 4             // heap pages mapped per page fault, 1 for just the one
 #define MAXOPBLOCKS 10            // max # of blocks any FS op writes
 #define LOGSIZE (MAXOPBLOCKS * 3) // max data blocks in on-disk log
 #define NBUF (MAXOPBLOCKS * 3)    // size of disk block cache
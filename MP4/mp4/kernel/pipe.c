@@ -79,12 +79,11 @@ void pipeclose(struct pipe *pi, int writable)
 
 int pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-    int i;
-    char ch;
+    int i, m;
     struct proc *pr = myproc();
 
     acquire(&pi->lock);
-    for (i = 0; i < n; i++)
+    for (i = 0; i < n; i += m)
     {
         while (pi->nwrite == pi->nread + PIPESIZE)
         { // DOC: pipewrite-full
@@ -96,9 +95,16 @@ int pipewrite(struct pipe *pi, uint64 addr, int n)
             wakeup(&pi->nread);
             sleep(&pi->nwrite, &pi->lock);
         }
-        if (copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+        // copy as much as fits before the buffer fills or wraps.
+        m = PIPESIZE - (pi->nwrite - pi->nread);
+        if (m > PIPESIZE - pi->nwrite % PIPESIZE)
+            m = PIPESIZE - pi->nwrite % PIPESIZE;
+        if (m > n - i)
+            m = n - i;
+        if (copyin(pr->pagetable, &pi->data[pi->nwrite % PIPESIZE], addr + i,
+                   m) == -1)
             break;
-        pi->data[pi->nwrite++ % PIPESIZE] = ch;
+        pi->nwrite += m;
     }
     wakeup(&pi->nread);
     release(&pi->lock);
@@ -107,9 +113,8 @@ int pipewrite(struct pipe *pi, uint64 addr, int n)
 
 int piperead(struct pipe *pi, uint64 addr, int n)
 {
-    int i;
+    int i, m;
     struct proc *pr = myproc();
-    char ch;
 
     acquire(&pi->lock);
     while (pi->nread == pi->nwrite && pi->writeopen)
@@ -121,13 +126,20 @@ int piperead(struct pipe *pi, uint64 addr, int n)
         }
         sleep(&pi->nread, &pi->lock); // DOC: piperead-sleep
     }
-    for (i = 0; i < n; i++)
+    for (i = 0; i < n; i += m)
     { // DOC: piperead-copy
         if (pi->nread == pi->nwrite)
             break;
-        ch = pi->data[pi->nread++ % PIPESIZE];
-        if (copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+        // what is there, up to where the buffer wraps.
+        m = pi->nwrite - pi->nread;
+        if (m > PIPESIZE - pi->nread % PIPESIZE)
+            m = PIPESIZE - pi->nread % PIPESIZE;
+        if (m > n - i)
+            m = n - i;
+        if (copyout(pr->pagetable, addr + i, &pi->data[pi->nread % PIPESIZE],
+                    m) == -1)
             break;
+        pi->nread += m;
     }
     wakeup(&pi->nwrite); // DOC: piperead-wakeup
     release(&pi->lock);
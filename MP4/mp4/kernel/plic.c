@@ -12,15 +12,20 @@ void plicinit(void)
 {
     // set desired IRQ priorities non-zero (otherwise disabled).
     *(uint32 *)(PLIC + UART0_IRQ * 4) = 1;
-    *(uint32 *)(PLIC + VIRTIO0_IRQ * 4) = 1;
+    for (int i = 0; i < NDISK; i++)
+        *(uint32 *)(PLIC + (VIRTIO0_IRQ + i) * 4) = 1;
 }
 
 void plicinithart(void)
 {
     int hart = cpuid();
+    uint32 enable = 1 << UART0_IRQ;
 
-    // set uart's enable bit for this hart's S-mode.
-    *(uint32 *)PLIC_SENABLE(hart) = (1 << UART0_IRQ) | (1 << VIRTIO0_IRQ);
+    for (int i = 0; i < NDISK; i++)
+        enable |= 1 << (VIRTIO0_IRQ + i);
+
+    // set uart's and the disks' enable bits for this hart's S-mode.
+    *(uint32 *)PLIC_SENABLE(hart) = enable;
 
     // set this hart's S-mode priority threshold to 0.
     *(uint32 *)PLIC_SPRIORITY(hart) = 0;
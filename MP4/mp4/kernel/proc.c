@@ -20,9 +20,55 @@ int force_disk_fail_id = -1;
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// Sleeping processes, hashed by channel, so that wakeup looks only at
+// processes that may be sleeping on its channel. A process goes on the
+// queue before sleep releases the caller's lock, so a wakeup that
+// holds that lock cannot miss it. wakeup takes its waiters off, but a
+// process woken some other way (kill, wakeup1) takes itself off once
+// it runs again.
+#define NSLEEPQ 61 // prime, since channels are mostly aligned addresses
+
+struct sleepq
+{
+    struct spinlock lock;
+    struct proc *head;
+} sleepq[NSLEEPQ];
+
+#ifdef SCHED_MLFQ
+// Multi-level feedback queue. A process starts at level 0 and drops a
+// level each time it runs for the whole of its level's quantum, so
+// CPU-bound processes sink while those that sleep first, like the
+// shell waiting for input, stay on top. The upper levels' quanta are
+// shorter, and a timer tick also preempts a process if someone of
+// higher priority is waiting. Every BOOST ticks everyone goes back to
+// level 0, so that the bottom level is not starved.
+static const int quantum[NRUNQ] = {1, 2, 4}; // ticks
+#define BOOST 20
+
+// p's level, after any boost it has missed. Caller holds p->lock.
+static int level(struct proc *p)
+{
+    if (p->boost != ticks / BOOST)
+    {
+        p->boost = ticks / BOOST;
+        p->prio = 0;
+        p->used = 0;
+    }
+    return p->prio;
+}
+#else
+static int level(struct proc *p) { return 0; }
+#endif
+
+static struct sleepq *chanq(void *chan)
+{
+    return &sleepq[(uint64)chan % NSLEEPQ];
+}
+
 extern void forkret(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static void setrunnable(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -32,6 +78,10 @@ void procinit(void)
     struct proc *p;
 
     initlock(&pid_lock, "nextpid");
+    for (int i = 0; i < NSLEEPQ; i++)
+        initlock(&sleepq[i].lock, "sleepq");
+    for (int i = 0; i < NCPU; i++)
+        initlock(&cpus[i].runq.lock, "runq");
     for (p = proc; p < &proc[NPROC]; p++)
     {
         initlock(&p->lock, "proc");
@@ -113,6 +163,8 @@ static struct proc *allocproc(void)
 
 found:
     p->pid = allocpid();
+    p->prio = 0;
+    p->used = 0;
 
     // Allocate a trapframe page.
     if ((p->trapframe = (struct trapframe *)kalloc()) == 0)
@@ -232,25 +284,25 @@ void userinit(void)
     safestrcpy(p->name, "initcode", sizeof(p->name));
     p->cwd = namei("/");
 
-    p->state = RUNNABLE;
+    setrunnable(p);
 
     release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
+// Grow or shrink user memory by n bytes. Growing only moves p->sz;
+// uvmlazy maps each page when it is first touched.
 // Return 0 on success, -1 on failure.
 int growproc(int n)
 {
-    uint sz;
+    uint64 sz;
     struct proc *p = myproc();
 
     sz = p->sz;
     if (n > 0)
     {
-        if ((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0)
-        {
+        if (sz + n >= TRAPFRAME || vma_overlap(p, sz, sz + n))
             return -1;
-        }
+        sz += n;
     }
     else if (n < 0)
     {
@@ -282,6 +334,12 @@ int fork(void)
         return -1;
     }
     np->sz = p->sz;
+    if (vma_fork(p, np) < 0)
+    {
+        freeproc(np);
+        release(&np->lock);
+        return -1;
+    }
 
     np->parent = p;
 
@@ -301,7 +359,7 @@ int fork(void)
 
     pid = np->pid;
 
-    np->state = RUNNABLE;
+    setrunnable(np);
 
     release(&np->lock);
 
@@ -345,6 +403,8 @@ void exit(int status)
     if (p == initproc)
         panic("init exiting");
 
+    vma_unmapall(p);
+
     // Close all open files.
     for (int fd = 0; fd < NOFILE; fd++)
     {
@@ -462,10 +522,92 @@ int wait(uint64 addr)
     }
 }
 
+// Mark p RUNNABLE and queue it on this CPU. Returns how many processes
+// are queued here now. Caller holds p->lock.
+static int requeue(struct proc *p)
+{
+    struct runq *rq = &mycpu()->runq;
+    int q = level(p), n;
+
+    p->state = RUNNABLE;
+    acquire(&rq->lock);
+    p->rqnext = 0;
+    if (rq->tail[q])
+        rq->tail[q]->rqnext = p;
+    else
+        rq->head[q] = p;
+    rq->tail[q] = p;
+    n = ++rq->n;
+    release(&rq->lock);
+    return n;
+}
+
+// Queue p on this CPU, where whoever woke or created it has just been
+// running. If something else is already waiting here, wake an idle
+// hart to steal one of them. Caller holds p->lock.
+static void setrunnable(struct proc *p)
+{
+    if (requeue(p) > 1)
+        timer_kick();
+}
+
+// Take the process at the head of rq's highest non-empty level, or
+// return 0.
+static struct proc *rqpop(struct runq *rq)
+{
+    struct proc *p = 0;
+
+    acquire(&rq->lock);
+#ifdef SCHED_MLFQ
+    if (rq->boost != ticks / BOOST)
+    {
+        // move the lower levels up; level() resets each process's
+        // own priority when it next runs.
+        rq->boost = ticks / BOOST;
+        for (int q = 1; q < NRUNQ; q++)
+        {
+            if (rq->head[q] == 0)
+                continue;
+            if (rq->tail[0])
+                rq->tail[0]->rqnext = rq->head[q];
+            else
+                rq->head[0] = rq->head[q];
+            rq->tail[0] = rq->tail[q];
+            rq->head[q] = rq->tail[q] = 0;
+        }
+    }
+#endif
+    for (int q = 0; q < NRUNQ && p == 0; q++)
+    {
+        if ((p = rq->head[q]) != 0)
+        {
+            rq->head[q] = p->rqnext;
+            if (rq->head[q] == 0)
+                rq->tail[q] = 0;
+            rq->n--;
+        }
+    }
+    release(&rq->lock);
+    return p;
+}
+
+// This CPU's queue is empty: take a process from the longest other
+// queue, or return 0.
+static struct proc *steal(struct cpu *c)
+{
+    struct cpu *o, *victim = 0;
+
+    for (o = cpus; o < &cpus[NCPU]; o++)
+        if (o != c && o->runq.n > 0 &&
+            (victim == 0 || o->runq.n > victim->runq.n))
+            victim = o;
+    return victim ? rqpop(&victim->runq) : 0;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - take a process from this CPU's run queue, or steal one.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -473,6 +615,7 @@ void scheduler(void)
 {
     struct proc *p;
     struct cpu *c = mycpu();
+    int idle = 0;
 
     c->proc = 0;
     for (;;)
@@ -480,32 +623,46 @@ void scheduler(void)
         // Avoid deadlock by ensuring that devices can interrupt.
         intr_on();
 
-        int found = 0;
-        for (p = proc; p < &proc[NPROC]; p++)
+        if ((p = rqpop(&c->runq)) == 0 && (p = steal(c)) == 0)
         {
-            acquire(&p->lock);
-            if (p->state == RUNNABLE)
+            if (!idle)
             {
-                // Switch to chosen process.  It is the process's job
-                // to release its lock and then reacquire it
-                // before jumping back to us.
-                p->state = RUNNING;
-                c->proc = p;
-                swtch(&c->context, &p->context);
-
-                // Process is done running for now.
-                // It should have changed its p->state before coming back.
-                c->proc = 0;
-
-                found = 1;
+                // stop the tick; look once more, since a hart that
+                // queued work before seeing us idle did not kick us.
+                timer_idle(1);
+                idle = 1;
+                continue;
             }
-            release(&p->lock);
+            // Wait for an interrupt. With interrupts off, one that
+            // queues a process after the check still ends the wfi.
+            intr_off();
+            if (c->runq.n == 0)
+                asm volatile("wfi");
+            continue;
         }
-        if (found == 0)
+        if (idle)
         {
-            intr_on();
-            asm volatile("wfi");
+            timer_idle(0);
+            idle = 0;
         }
+
+        // p may still be on its way out of a CPU that queued it in
+        // yield(); that CPU holds p->lock until it is off p's stack.
+        acquire(&p->lock);
+        if (p->state != RUNNABLE)
+            panic("scheduler: queued process not runnable");
+
+        // Switch to chosen process.  It is the process's job
+        // to release its lock and then reacquire it
+        // before jumping back to us.
+        p->state = RUNNING;
+        c->proc = p;
+        swtch(&c->context, &p->context);
+
+        // Process is done running for now.
+        // It should have changed its p->state before coming back.
+        c->proc = 0;
+        release(&p->lock);
     }
 }
 
@@ -540,7 +697,43 @@ void yield(void)
 {
     struct proc *p = myproc();
     acquire(&p->lock);
-    p->state = RUNNABLE;
+    requeue(p);
+    sched();
+    release(&p->lock);
+}
+
+// Called on each timer interrupt that finds p running. Round-robin
+// gives up the CPU every tick; SCHED_MLFQ only once p has used its
+// quantum, or when a process of higher priority is waiting here.
+void preempt(void)
+{
+    struct proc *p = myproc();
+
+    acquire(&p->lock);
+#ifdef SCHED_MLFQ
+    struct runq *rq = &mycpu()->runq;
+    int q = level(p), ahead = 0;
+
+    if (++p->used >= quantum[q])
+    {
+        p->used = 0;
+        if (q + 1 < NRUNQ)
+            p->prio = q + 1;
+    }
+    else
+    {
+        // an unlocked look is enough; the next tick looks again.
+        for (int i = 0; i < q; i++)
+            ahead |= rq->head[i] != 0;
+        if (!ahead)
+        {
+            release(&p->lock);
+            return;
+        }
+    }
+#endif
+    // this hart runs whatever is next, so there is nothing to steal.
+    requeue(p);
     sched();
     release(&p->lock);
 }
@@ -566,6 +759,78 @@ void forkret(void)
     usertrapret();
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void kthreadret(void)
+{
+    struct proc *p = myproc();
+
+    // Still holding p->lock from scheduler.
+    release(&p->lock);
+
+    p->kfn(p->karg);
+    panic("kthread returned");
+}
+
+// Start a process that runs fn(arg) in the kernel and never
+// returns to user space. Returns its pid, or -1.
+int kthread_create(void (*fn)(void *), void *arg, char *name)
+{
+    struct proc *p;
+    int pid;
+
+    if ((p = allocproc()) == 0)
+        return -1;
+
+    p->context.ra = (uint64)kthreadret;
+    p->kfn = fn;
+    p->karg = arg;
+    p->parent = initproc;
+    safestrcpy(p->name, name, sizeof(p->name));
+    pid = p->pid;
+
+    setrunnable(p);
+
+    release(&p->lock);
+    return pid;
+}
+
+// Put p, about to sleep on chan, on chan's sleep queue.
+// Caller holds p->lock.
+static void sqinsert(struct proc *p, void *chan)
+{
+    struct sleepq *sq = chanq(chan);
+
+    acquire(&sq->lock);
+    p->chan = chan;
+    p->sq = sq;
+    p->sqnext = sq->head;
+    sq->head = p;
+    release(&sq->lock);
+}
+
+// Take p off its sleep queue, if a wakeup has not already.
+// Caller holds p->lock.
+static void sqremove(struct proc *p)
+{
+    struct sleepq *sq = p->sq;
+    struct proc **pp;
+
+    if (sq == 0)
+        return;
+    acquire(&sq->lock);
+    for (pp = &sq->head; *pp != 0; pp = &(*pp)->sqnext)
+    {
+        if (*pp == p)
+        {
+            *pp = p->sqnext;
+            break;
+        }
+    }
+    p->sq = 0;
+    release(&sq->lock);
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void sleep(void *chan, struct spinlock *lk)
@@ -581,16 +846,19 @@ void sleep(void *chan, struct spinlock *lk)
     if (lk != &p->lock)
     {                      // DOC: sleeplock0
         acquire(&p->lock); // DOC: sleeplock1
+        sqinsert(p, chan);
         release(lk);
     }
+    else
+        sqinsert(p, chan);
 
-    // Go to sleep.
-    p->chan = chan;
+    // Go to sleep. sqinsert set p->chan.
     p->state = SLEEPING;
 
     sched();
 
     // Tidy up.
+    sqremove(p);
     p->chan = 0;
 
     // Reacquire original lock.
@@ -603,19 +871,51 @@ void sleep(void *chan, struct spinlock *lk)
 
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
-void wakeup(void *chan)
-{
-    struct proc *p;
+void wakeup(void *chan) { wakeupn(chan, NPROC); }
 
-    for (p = proc; p < &proc[NPROC]; p++)
+// Wake up at most max of the processes sleeping on chan.
+// Returns how many it woke.
+int wakeupn(void *chan, int max)
+{
+    struct sleepq *sq = chanq(chan);
+    struct proc *p, **pp, *w[NPROC];
+    int n, r = 0;
+
+    // take chan's sleepers off the queue; p->lock comes after
+    // the queue lock, so wake them once it is released. One that
+    // is queued but no longer asleep, such as a killed process
+    // that has not taken itself off yet, does not count, so look
+    // again for others until max are woken or none are left.
+    do
     {
-        acquire(&p->lock);
-        if (p->state == SLEEPING && p->chan == chan)
+        n = 0;
+        acquire(&sq->lock);
+        for (pp = &sq->head; (p = *pp) != 0 && n < max - r;)
         {
-            p->state = RUNNABLE;
+            if (p->chan == chan)
+            {
+                *pp = p->sqnext;
+                p->sq = 0;
+                w[n++] = p;
+            }
+            else
+                pp = &p->sqnext;
         }
-        release(&p->lock);
-    }
+        release(&sq->lock);
+
+        for (int i = 0; i < n; i++)
+        {
+            p = w[i];
+            acquire(&p->lock);
+            if (p->state == SLEEPING && p->chan == chan)
+            {
+                setrunnable(p);
+                r++;
+            }
+            release(&p->lock);
+        }
+    } while (n > 0 && r < max);
+    return r;
 }
 
 // Wake up p if it is sleeping in wait(); used by exit().
@@ -626,7 +926,7 @@ static void wakeup1(struct proc *p)
         panic("wakeup1");
     if (p->chan == p && p->state == SLEEPING)
     {
-        p->state = RUNNABLE;
+        setrunnable(p);
     }
 }
 
@@ -646,7 +946,7 @@ int kill(int pid)
             if (p->state == SLEEPING)
             {
                 // Wake process from sleep().
-                p->state = RUNNABLE;
+                setrunnable(p);
             }
             release(&p->lock);
             return 0;
@@ -19,6 +19,23 @@ struct context
     uint64 s11;
 };
 
+#ifdef SCHED_MLFQ
+#define NRUNQ 3 // priority levels, 0 is the highest
+#else
+#define NRUNQ 1
+#endif
+
+// A CPU's queues of RUNNABLE processes, one per priority level,
+// linked through p->rqnext.
+struct runq
+{
+    struct spinlock lock;
+    struct proc *head[NRUNQ];
+    struct proc *tail[NRUNQ];
+    int n;      // read without the lock as a hint by idle CPUs
+    uint boost; // the last priority boost applied to these queues
+};
+
 // Per-CPU state.
 struct cpu
 {
@@ -26,6 +43,7 @@ struct cpu
     struct context context; // swtch() here to enter scheduler().
     int noff;               // Depth of push_off() nesting.
     int intena;             // Were interrupts enabled before push_off()?
+    struct runq runq;       // Processes waiting to run here.
 };
 
 extern struct cpu cpus[NCPU];
@@ -83,6 +101,19 @@ struct trapframe
     /* 280 */ uint64 t6;
 };
 
+// A region of a file or shared memory segment mapped into a process,
+// see mmap.c.
+struct vma
+{
+    uint64 addr; // start, page-aligned, or 0 if the slot is free
+    uint64 len;  // bytes, a multiple of PGSIZE
+    int prot;    // PROT_READ, PROT_WRITE
+    int flags;   // MAP_SHARED or MAP_PRIVATE
+    struct file *f;
+    struct shm *shm; // or the shared memory segment mapped, if f is 0
+    uint off;        // offset of addr in f or shm
+};
+
 enum procstate
 {
     UNUSED,
@@ -104,6 +135,15 @@ struct proc
     int killed;           // If non-zero, have been killed
     int xstate;           // Exit status to be returned to parent's wait
     int pid;              // Process ID
+    int prio;             // Run queue level (SCHED_MLFQ)
+    int used;             // Ticks of its quantum used at that level
+    uint boost;           // Priority boost it last got
+    struct proc *rqnext;  // Next in run queue, under the queue's lock
+    struct sleepq *sq;    // Sleep queue p is on, under that queue's lock
+    struct proc *sqnext;  // Next on it
+    struct timerq *tq;    // Deadline list p is on (timer.c)
+    struct proc *tnext;   // Next on it
+    uint64 wakeat;        // Its deadline
 
     // these are private to the process, so p->lock need not be held.
     uint64 kstack;               // Virtual address of kernel stack
@@ -112,6 +152,9 @@ struct proc
     struct trapframe *trapframe; // data page for trampoline.S
     struct context context;      // swtch() here to run process
     struct file *ofile[NOFILE];  // Open files
+    struct vma vmas[NVMA];       // Mapped files
     struct inode *cwd;           // Current directory
     char name[16];               // Process name (debugging)
+    void (*kfn)(void *);         // Kernel thread body, see kthread_create
+    void *karg;
 };
@@ -0,0 +1,305 @@
+// RAID-1 write-intent bitmap and background resync.
+//
+// bwrite calls raid_markdirty for every copy of a block it cannot
+// write, and the bitmap reaches the surviving disk before the data
+// does. Once the missing disk is back, the resync kernel thread copies
+// just the marked blocks to it from the other mirror, a few at a time
+// so that foreground I/O keeps going. Until a block is copied, bread
+// does not send reads for it to the stale disk.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "bdev.h"
+#include "raid.h"
+
+#define RESYNC_BATCH 8 // blocks copied between pauses
+#define RESYNC_PAUSE 1 // ticks to pause for
+
+extern int force_read_error_pbn;
+extern int force_disk_fail_id;
+
+struct
+{
+    struct spinlock lock;
+    int dev;
+    uint nblocks;
+    uint mapblock;
+    struct raidmap map; // protected by lock
+    uint nstale[2];     // dirty blocks each disk lacks, under lock
+    uint cursor;        // next block resync looks at
+    uint copied;
+    struct buf mapbuf[RAIDMAPBLKS]; // for writing map, under mapbuf[0].lock
+    struct buf copybuf; // used only by the resync thread
+} raid;
+
+static int isdirty(uint b) { return raid.map.bits[b / 8] & (1 << (b % 8)); }
+
+// The disk that lacks dirty block b.
+static int staledisk(uint b) { return (raid.map.which[b / 8] >> (b % 8)) & 1; }
+
+static void setstaledisk(uint b, int d)
+{
+    if (d)
+        raid.map.which[b / 8] |= 1 << (b % 8);
+    else
+        raid.map.which[b / 8] &= ~(1 << (b % 8));
+}
+
+// Is there a dirty block that resync can copy now?
+static int resyncable(void)
+{
+    for (int d = 0; d < 2; d++)
+        if (raid.nstale[d] > 0 && force_disk_fail_id != d)
+            return 1;
+    return 0;
+}
+
+// Can copy d of block b be written right now?
+static int writable(uint b, int d)
+{
+    return force_disk_fail_id != d && !(d == 0 && force_read_error_pbn == b);
+}
+
+// Write the bitmap to each copy that can take it. Which disk lacks a
+// block goes out before the bit that says one does.
+static void flushmap(void)
+{
+    struct pblock pbs[NMEMBER];
+    int n;
+
+    acquiresleep(&raid.mapbuf[0].lock);
+    acquire(&raid.lock);
+    for (int i = 0; i < RAIDMAPBLKS; i++)
+        memmove(raid.mapbuf[i].data, (char *)&raid.map + i * BSIZE, BSIZE);
+    release(&raid.lock);
+    for (int i = RAIDMAPBLKS - 1; i >= 0; i--)
+    {
+        n = 0;
+        for (int d = 0; bdev_locate(raid.mapblock + i, d, &pbs[n]); d++)
+            if (writable(raid.mapblock + i, d))
+                n++;
+        if (n > 0)
+            virtio_disk_rwv(&raid.mapbuf[i], pbs, n, 1);
+    }
+    releasesleep(&raid.mapbuf[0].lock);
+}
+
+// Record that copy d of blockno is out of date, and make the record
+// durable before returning. If the other copy was the stale one, it is
+// the one being written now, so d becomes the one that lacks the block.
+void raid_markdirty(uint blockno, int d)
+{
+    acquire(&raid.lock);
+    if (isdirty(blockno) && staledisk(blockno) == d)
+    {
+        release(&raid.lock);
+        return;
+    }
+    if (!isdirty(blockno))
+    {
+        raid.map.bits[blockno / 8] |= 1 << (blockno % 8);
+        raid.map.ndirty++;
+    }
+    else
+        raid.nstale[staledisk(blockno)]--;
+    setstaledisk(blockno, d);
+    raid.nstale[d]++;
+    raid.map.stale = d;
+    release(&raid.lock);
+
+    flushmap();
+    wakeup(&raid);
+}
+
+// Both copies of blockno were just written; it needs no resync.
+// The cleared bit reaches disk with the next flush of the map.
+void raid_markclean(uint blockno)
+{
+    acquire(&raid.lock);
+    if (isdirty(blockno))
+    {
+        raid.map.bits[blockno / 8] &= ~(1 << (blockno % 8));
+        raid.nstale[staledisk(blockno)]--;
+        if (--raid.map.ndirty == 0)
+            raid.map.stale = -1;
+    }
+    release(&raid.lock);
+}
+
+// Does copy d of blockno lack writes that the other copy has?
+int raid_stale(uint blockno, int d)
+{
+    int r;
+
+    acquire(&raid.lock);
+    r = isdirty(blockno) && staledisk(blockno) == d;
+    release(&raid.lock);
+    return r;
+}
+
+// Can copy d of blockno be read and written, for csum.c?
+int raid_usable(uint blockno, int d)
+{
+    return writable(blockno, d) && !raid_stale(blockno, d);
+}
+
+// A failure hook changed; let resync see whether it can run.
+void raid_kick(void) { wakeup(&raid); }
+
+void raid_status(struct resyncstat *st)
+{
+    acquire(&raid.lock);
+    st->stale = raid.map.ndirty == 0                  ? -1
+                : raid.nstale[1] > raid.nstale[0] ? 1
+                                                  : 0;
+    st->ndirty = raid.map.ndirty;
+    st->copied = raid.copied;
+    st->waiting = raid.map.ndirty > 0 && !resyncable();
+    release(&raid.lock);
+}
+
+static void pause(int n) { sleepuntil(timer_now() + (uint64)n * TICKCYCLES); }
+
+// Copy block b from the other mirror to dst, the disk that lacks it,
+// holding b's buffer so that no bwrite of b runs meanwhile.
+static int copyblock(uint b, int dst)
+{
+    struct buf *bp;
+    struct pblock src, to;
+    int ok = 0;
+
+    bp = bget(raid.dev, b);
+    if (raid_stale(b, dst) && writable(b, dst))
+    {
+        bdev_locate(b, !dst, &src);
+        bdev_locate(b, dst, &to);
+        if (virtio_disk_rwv(&raid.copybuf, &src, 1, 0) == 0 &&
+            virtio_disk_rwv(&raid.copybuf, &to, 1, 1) == 0)
+        {
+            raid_markclean(b);
+            ok = 1;
+        }
+    }
+    brelse(bp);
+    return ok;
+}
+
+static void resync(void *arg)
+{
+    uint b, i;
+    int dst, failed, n = 0;
+
+    for (;;)
+    {
+        acquire(&raid.lock);
+        while (!resyncable())
+        {
+            if (n > 0)
+            {
+                // finished a run; record the clean bits.
+                n = 0;
+                release(&raid.lock);
+                flushmap();
+                acquire(&raid.lock);
+                continue;
+            }
+            sleep(&raid, &raid.lock);
+        }
+        // the next block that a disk that is up lacks. The hook can
+        // fail a disk at any time, so read it once and look at each
+        // block at most once.
+        failed = *(volatile int *)&force_disk_fail_id;
+        b = raid.cursor;
+        for (i = 0; i < raid.nblocks; i++)
+        {
+            if (isdirty(b) && staledisk(b) != failed)
+                break;
+            b = (b + 1) % raid.nblocks;
+        }
+        if (i == raid.nblocks)
+        {
+            // none after all; wait for the hook to change.
+            sleep(&raid, &raid.lock);
+            release(&raid.lock);
+            continue;
+        }
+        raid.cursor = (b + 1) % raid.nblocks;
+        dst = staledisk(b);
+        release(&raid.lock);
+
+        if (copyblock(b, dst))
+        {
+            acquire(&raid.lock);
+            raid.copied++;
+            release(&raid.lock);
+            if (++n % RESYNC_BATCH == 0)
+            {
+                flushmap();
+                pause(RESYNC_PAUSE);
+            }
+        }
+        else
+        {
+            // that block cannot be written yet; don't spin on it.
+            pause(RESYNC_PAUSE);
+        }
+    }
+}
+
+void raidinit(void)
+{
+    initlock(&raid.lock, "raid");
+    initsleeplock(&raid.mapbuf[0].lock, "raidmap");
+    raid.map.magic = RAIDMAGIC;
+    raid.map.stale = -1;
+}
+
+// Load the bitmap, preferring the copy that records more dirty blocks,
+// and start the resync thread. Called by fsinit, for RAID-1 layouts.
+void raidstart(int dev, struct superblock *sb)
+{
+    struct raidmap *m = (struct raidmap *)raid.mapbuf[0].data;
+    struct buf *bs[RAIDMAPBLKS];
+    struct pblock p[RAIDMAPBLKS];
+
+    if (!bdev_mirrored())
+        return;
+    if (sb->size > RAIDBITS * 8)
+        panic("raidstart: file system too large for the map");
+
+    raid.dev = dev;
+    raid.nblocks = sb->size;
+    raid.mapblock = sb->raidmap;
+
+    for (int d = 0; bdev_locate(raid.mapblock, d, &p[0]); d++)
+    {
+        for (int i = 0; i < RAIDMAPBLKS; i++)
+        {
+            bs[i] = &raid.mapbuf[i];
+            bdev_locate(raid.mapblock + i, d, &p[i]);
+        }
+        if (virtio_disk_rwb(bs, p, RAIDMAPBLKS, 0) == 0 &&
+            m->magic == RAIDMAGIC && m->ndirty > raid.map.ndirty)
+        {
+            for (int i = 0; i < RAIDMAPBLKS; i++)
+                memmove((char *)&raid.map + i * BSIZE, raid.mapbuf[i].data,
+                        BSIZE);
+        }
+    }
+    for (uint b = 0; b < raid.nblocks; b++)
+        if (isdirty(b))
+            raid.nstale[staledisk(b)]++;
+    for (int d = 0; d < 2; d++)
+        if (raid.nstale[d] > 0)
+            printf("raid: disk %d needs %d blocks resynced\n", d,
+                   raid.nstale[d]);
+
+    if (kthread_create(resync, 0, "resync") < 0)
+        panic("raidinit: resync thread");
+}
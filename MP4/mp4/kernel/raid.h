@@ -0,0 +1,48 @@
+// RAID-1 write-intent bitmap, kept in the RAIDMAPBLKS blocks from
+// sb.raidmap of each mirror. A bit is set for every block written while
+// one of its two copies could not be, and cleared once resync has
+// copied the block to that disk. Which disk lacks the block is recorded
+// per block, in the second map block, since each disk can fall behind
+// on different blocks. Both kernel and user programs use this header
+// file, after param.h.
+
+#define RAIDMAGIC 0x52414931
+#define RAIDMAPBLKS 2
+#define RAIDBITS (BSIZE - 3 * sizeof(uint)) // bytes in each bitmap
+
+struct raidmap
+{
+    // block sb.raidmap
+    uint magic;  // Must be RAIDMAGIC
+    int stale;   // Disk that last fell behind, or -1 if none is
+    uint ndirty; // Number of bits set
+    uchar bits[RAIDBITS]; // Block needs resync
+    // block sb.raidmap + 1
+    uchar which[BSIZE]; // And disk 1 lacks it if set, else disk 0
+};
+
+_Static_assert(sizeof(struct raidmap) == RAIDMAPBLKS * BSIZE,
+               "raidmap must fill its blocks");
+_Static_assert(RAIDBITS * 8 >= FSSIZE, "raidmap too small for FSSIZE");
+
+// Progress of the background resync, from resync_status().
+struct resyncstat
+{
+    int stale;   // Disk being brought back in sync, or -1
+                 // (the one with more blocks, if both lack some)
+    uint ndirty; // Blocks it still lacks
+    uint copied; // Blocks copied to it since boot
+    int waiting; // Non-zero while the disk is still failed
+};
+
+// Progress of the background scrubber, from scrub_status().
+struct scrubstat
+{
+    uint passes;     // Full passes finished
+    uint cursor;     // Next block it looks at
+    uint size;       // Blocks in a pass
+    uint scanned;    // Blocks compared since boot
+    uint mismatches; // Blocks whose copies differed
+    uint repaired;   // Bad copies rewritten from a good one
+    uint unfixable;  // Mismatched blocks with no copy known to be good
+};
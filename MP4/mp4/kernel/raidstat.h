@@ -0,0 +1,29 @@
+// RAID-1 event counters and recent events, from raidstat(). Both
+// kernel and user programs use this header file.
+
+#define RS_WRITE 0      // copy written
+#define RS_SKIP_DISK 1  // write skipped, disk failed
+#define RS_SKIP_BLOCK 2 // write skipped, block failed
+#define RS_WRITE_ERR 3  // write failed
+#define RS_READ 4       // copy read
+#define RS_FALLBACK 5   // copy read after another failed or was failed
+#define NRSEVENT 6
+
+#define RS_NCOPY 4 // copies counted, as NMEMBER in bdev.h
+#define RS_RING 32 // recent events kept per CPU
+
+struct raidevent
+{
+    uint seq;      // order of the event, across CPUs
+    ushort type;   // RS_*
+    ushort copy;   // which copy of the block
+    uint blockno;  // logical block
+    uint pblockno; // block on that copy's disk
+};
+
+struct raidstat
+{
+    uint count[NRSEVENT][RS_NCOPY]; // events by type and copy
+    int verbose;                    // are BW_DIAG lines printed?
+    struct raidevent ev[NCPU * RS_RING];
+};
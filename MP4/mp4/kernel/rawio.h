@@ -0,0 +1,12 @@
+// Vectored raw block I/O, raw_readv() and raw_writev(). Both kernel
+// and user programs use this header file.
+
+#define MAXRAWV 16    // most blocks per call
+#define RAW_NOCACHE 1 // read from the disks even if the cache has the block
+
+struct rawvec
+{
+    int disk;  // virtio disk; must be 0 without RAW_NOCACHE
+    uint pbn;  // block on that disk
+    char *buf; // BSIZE bytes of user memory
+};
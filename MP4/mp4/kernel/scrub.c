@@ -0,0 +1,148 @@
+// Background scrubber. A kernel thread walks the file system a few
+// blocks at a time and reads every usable copy of each block. A copy
+// that fails the block's checksum is rewritten from one that passes;
+// for blocks without a checksum, copies that differ are only counted,
+// since there is no telling which one is right.
+//
+// The scrubber runs only after the buffer cache has done no I/O for
+// SCRUB_IDLE ticks, and pauses a tick after each batch, so foreground
+// I/O never waits long behind it. The RAID map is skipped, as are
+// copies that resync is still bringing up to date.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "bdev.h"
+#include "raid.h"
+
+#define SCRUB_BATCH 8    // blocks scrubbed between pauses
+#define SCRUB_IDLE 10    // ticks without foreground I/O before a batch
+#define SCRUB_REST 3000  // ticks between passes
+
+static struct
+{
+    struct spinlock lock;
+    int dev;
+    uint start; // first block scrubbed
+    uint raidmap;
+    struct scrubstat st; // protected by lock
+    struct buf *copy[NMEMBER];
+} scrub;
+
+static void pause(int n) { sleepuntil(timer_now() + (uint64)n * TICKCYCLES); }
+
+static int usable(uint b, int c)
+{
+    return !bdev_mirrored() || raid_usable(b, c);
+}
+
+// Scrub block b, holding its buffer so that no bwrite of it runs
+// meanwhile.
+static void scrubblock(uint b)
+{
+    struct pblock pb[NMEMBER];
+    int n = 0, good = -1, differ = 0, bad = 0, repaired = 0, r;
+    struct buf *bp;
+
+    bp = bget(scrub.dev, b);
+    for (int c = 0; bdev_locate(b, c, &pb[n]); c++)
+    {
+        if (!usable(b, c) || virtio_disk_rwv(scrub.copy[n], &pb[n], 1, 0))
+            continue;
+        if (n > 0 && memcmp(scrub.copy[n]->data, scrub.copy[0]->data, BSIZE))
+            differ = 1;
+        n++;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        r = csum_match(b, scrub.copy[i]->data);
+        if (r == 0)
+            bad |= 1 << i;
+        else if (r == 1 && good < 0)
+            good = i;
+    }
+    for (int i = 0; good >= 0 && i < n; i++)
+    {
+        if ((bad & (1 << i)) &&
+            virtio_disk_rwv(scrub.copy[good], &pb[i], 1, 1) == 0)
+        {
+            printf("scrub: rewrote block %d on disk %d block %d\n", b,
+                   pb[i].disk, pb[i].blockno);
+            repaired++;
+        }
+    }
+    brelse(bp);
+
+    acquire(&scrub.lock);
+    scrub.st.scanned++;
+    if (differ || bad)
+    {
+        scrub.st.mismatches++;
+        scrub.st.repaired += repaired;
+        if (good < 0)
+            scrub.st.unfixable++;
+    }
+    release(&scrub.lock);
+}
+
+static void scrubber(void *arg)
+{
+    uint b;
+
+    for (;;)
+    {
+        while (bdev_idle() < SCRUB_IDLE)
+            pause(SCRUB_IDLE);
+
+        for (int i = 0; i < SCRUB_BATCH; i++)
+        {
+            acquire(&scrub.lock);
+            b = scrub.st.cursor;
+            if (++scrub.st.cursor == scrub.st.size)
+            {
+                scrub.st.cursor = scrub.start;
+                scrub.st.passes++;
+            }
+            release(&scrub.lock);
+            if (b < scrub.raidmap || b >= scrub.raidmap + RAIDMAPBLKS)
+                scrubblock(b);
+            if (b + 1 == scrub.st.size)
+            {
+                pause(SCRUB_REST);
+                break;
+            }
+        }
+        pause(1);
+    }
+}
+
+// Start the scrubber on the inode, bitmap and data blocks and the
+// checksum table. Called by fsinit.
+void scrubstart(int dev, struct superblock *sb)
+{
+    initlock(&scrub.lock, "scrub");
+    scrub.dev = dev;
+    scrub.start = sb->inodestart;
+    scrub.raidmap = sb->raidmap;
+    scrub.st.size = sb->size;
+    scrub.st.cursor = scrub.start;
+    for (int i = 0; i < NMEMBER; i++)
+        if ((scrub.copy[i] = (struct buf *)kalloc()) == 0)
+            panic("scrubstart: kalloc");
+
+    if (kthread_create(scrubber, 0, "scrub") < 0)
+        panic("scrubstart: scrub thread");
+}
+
+void scrub_status(struct scrubstat *st)
+{
+    acquire(&scrub.lock);
+    *st = scrub.st;
+    release(&scrub.lock);
+}
@@ -0,0 +1,222 @@
+// Shared memory segments, and futexes to wait on words in them.
+//
+// shmget finds or makes a segment of zeroed pages, and shmat maps one
+// into the process (see mmapshm in mmap.c), where munmap takes it out
+// again. A segment lasts until shmrm removes it, as with System V's
+// IPC_RMID, and then until its last mapping goes. Each mapped page
+// takes a kref, so that its memory lasts while any page table still
+// has it.
+//
+// An id names a slot and the generation of the segment in it, so an id
+// kept after its segment was removed cannot attach a later one.
+//
+// futexwait sleeps until futexwake is called on the same word. The
+// word is named by its physical address, so processes that map a
+// segment at different addresses still meet on it.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+
+#define MAXGEN (0x7fffffff / NSHM) // generations before ids repeat
+
+struct shm
+{
+    int key;     // 0 for a segment that shmget will not find again
+    int npages;  // 0 if the slot is free
+    int ref;     // mappings of it, and 1 until it is removed
+    int removed; // has shmrm been called?
+    int gen;     // bumped each time the slot is used
+    char *pages[SHMPAGES];
+};
+
+struct
+{
+    struct spinlock lock;
+    struct shm shm[NSHM];
+} shmtab;
+
+// futexwait checks the word and sleeps, and futexwake wakes, under
+// this lock, so that a wake cannot come between the two.
+struct spinlock futexlock;
+
+void shminit(void)
+{
+    initlock(&shmtab.lock, "shmtab");
+    initlock(&futexlock, "futex");
+}
+
+static int shmid(struct shm *s) { return s->gen * NSHM + (s - shmtab.shm); }
+
+// The segment that id names, if it is still there and not removed.
+// Caller holds shmtab.lock.
+static struct shm *shmlookup(int id)
+{
+    struct shm *s;
+
+    if (id < 0)
+        return 0;
+    s = &shmtab.shm[id % NSHM];
+    if (s->npages == 0 || s->removed || s->gen != id / NSHM)
+        return 0;
+    return s;
+}
+
+// The id of the segment with key, or of a new one of size bytes if
+// there is none or key is 0. Returns -1 if an existing segment is
+// smaller than size, or there is no free segment or memory.
+int shmget(int key, uint64 size)
+{
+    struct shm *s, *free = 0;
+    int i, npages = PGROUNDUP(size) / PGSIZE;
+
+    if (npages <= 0 || npages > SHMPAGES)
+        return -1;
+
+    acquire(&shmtab.lock);
+    for (s = shmtab.shm; s < shmtab.shm + NSHM; s++)
+    {
+        if (s->npages == 0)
+        {
+            if (free == 0)
+                free = s;
+        }
+        else if (key != 0 && s->key == key && !s->removed)
+        {
+            i = npages <= s->npages ? shmid(s) : -1;
+            release(&shmtab.lock);
+            return i;
+        }
+    }
+    if ((s = free) == 0)
+    {
+        release(&shmtab.lock);
+        return -1;
+    }
+    for (i = 0; i < npages; i++)
+    {
+        if ((s->pages[i] = kalloc()) == 0)
+        {
+            while (--i >= 0)
+                kfree(s->pages[i]);
+            release(&shmtab.lock);
+            return -1;
+        }
+        memset(s->pages[i], 0, PGSIZE);
+    }
+    s->key = key;
+    s->npages = npages;
+    s->ref = 1;
+    s->removed = 0;
+    if (++s->gen > MAXGEN)
+        s->gen = 1;
+    i = shmid(s);
+    release(&shmtab.lock);
+    return i;
+}
+
+// Remove segment id: shmget no longer finds it, shmat no longer maps
+// it, and it goes away with its last mapping. Returns -1 if there is
+// no such segment.
+int shmrm(int id)
+{
+    struct shm *s;
+
+    acquire(&shmtab.lock);
+    if ((s = shmlookup(id)) == 0)
+    {
+        release(&shmtab.lock);
+        return -1;
+    }
+    s->removed = 1;
+    release(&shmtab.lock);
+    shmput(s);
+    return 0;
+}
+
+// Map segment id into the current process. Returns the address, or -1.
+uint64 shmat(int id)
+{
+    struct shm *s;
+    uint64 a;
+
+    acquire(&shmtab.lock);
+    if ((s = shmlookup(id)) == 0)
+    {
+        release(&shmtab.lock);
+        return -1;
+    }
+    s->ref++;
+    release(&shmtab.lock);
+
+    if ((a = mmapshm(s, (uint64)s->npages * PGSIZE)) == -1)
+        shmput(s);
+    return a;
+}
+
+// Page i of s, which a mapping keeps.
+char *shmpage(struct shm *s, int i)
+{
+    if (i < 0 || i >= s->npages)
+        panic("shmpage");
+    return s->pages[i];
+}
+
+void shmdup(struct shm *s)
+{
+    acquire(&shmtab.lock);
+    s->ref++;
+    release(&shmtab.lock);
+}
+
+// Drop a reference to s, and free s with the last one. Pages still in
+// page tables last until those are unmapped too.
+void shmput(struct shm *s)
+{
+    acquire(&shmtab.lock);
+    if (--s->ref > 0)
+    {
+        release(&shmtab.lock);
+        return;
+    }
+    for (int i = 0; i < s->npages; i++)
+        kfree(s->pages[i]);
+    s->npages = 0;
+    release(&shmtab.lock);
+}
+
+// Sleep until a futexwake on addr, if the word there is still val.
+// Returns -1 if it is not, or addr is not in a shared memory segment.
+int futexwait(uint64 addr, int val)
+{
+    uint64 pa;
+
+    if (addr % sizeof(int) != 0)
+        return -1;
+    acquire(&futexlock);
+    if ((pa = vma_shmpa(addr)) == 0 || *(volatile int *)pa != val)
+    {
+        release(&futexlock);
+        return -1;
+    }
+    sleep((void *)pa, &futexlock);
+    release(&futexlock);
+    return 0;
+}
+
+// Wake at most n of the processes waiting on addr. Returns how many.
+int futexwake(uint64 addr, int n)
+{
+    uint64 pa;
+    int r;
+
+    if (addr % sizeof(int) != 0 || (pa = vma_shmpa(addr)) == 0)
+        return -1;
+    acquire(&futexlock);
+    r = wakeupn((void *)pa, n);
+    release(&futexlock);
+    return r;
+}
@@ -57,17 +57,15 @@ void timerinit()
     // each CPU has a separate source of timer interrupts.
     int id = r_mhartid();
 
-    // ask the CLINT for a timer interrupt.
-    int interval = 1000000; // cycles; about 1/10th second in qemu.
-    *(uint64 *)CLINT_MTIMECMP(id) = *(uint64 *)CLINT_MTIME + interval;
+    // ask the CLINT for the first timer interrupt; timerintr()
+    // in timer.c programs the ones after it.
+    *(uint64 *)CLINT_MTIMECMP(id) = *(uint64 *)CLINT_MTIME + TICKCYCLES;
 
     // prepare information in scratch[] for timervec.
     // scratch[0..3] : space for timervec to save registers.
     // scratch[4] : address of CLINT MTIMECMP register.
-    // scratch[5] : desired interval (in cycles) between timer interrupts.
     uint64 *scratch = &mscratch0[32 * id];
     scratch[4] = CLINT_MTIMECMP(id);
-    scratch[5] = interval;
     w_mscratch((uint64)scratch);
 
     // set the machine-mode trap handler.
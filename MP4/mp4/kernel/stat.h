@@ -17,3 +17,12 @@ struct stat
     uint64 size; // Size of file in bytes
     short mode;
 };
+
+// A run of a file's blocks that are also consecutive on disk, from
+// fiemap().
+struct fextent
+{
+    uint lbn; // First block in the file
+    uint pbn; // Its disk block
+    uint len; // Number of blocks
+};
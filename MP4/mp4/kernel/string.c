@@ -1,13 +1,19 @@
 #include "types.h"
 
+// memset and memmove store 8-byte words once dst is aligned, when
+// src can be aligned along with it, and bytes only at the ends.
+
 void *memset(void *dst, int c, uint n)
 {
     char *cdst = (char *)dst;
-    int i;
-    for (i = 0; i < n; i++)
-    {
-        cdst[i] = c;
-    }
+    uint64 w = (uchar)c * 0x0101010101010101UL;
+
+    for (; n > 0 && (uint64)cdst % 8 != 0; n--)
+        *cdst++ = c;
+    for (; n >= 8; n -= 8, cdst += 8)
+        *(uint64 *)cdst = w;
+    while (n-- > 0)
+        *cdst++ = c;
     return dst;
 }
 
@@ -31,19 +37,41 @@ void *memmove(void *dst, const void *src, uint n)
 {
     const char *s;
     char *d;
+    int words;
 
     s = src;
     d = dst;
+    words = (uint64)s % 8 == (uint64)d % 8;
     if (s < d && s + n > d)
     {
         s += n;
         d += n;
+        if (words)
+        {
+            for (; n > 0 && (uint64)d % 8 != 0; n--)
+                *--d = *--s;
+            for (; n >= 8; n -= 8)
+            {
+                d -= 8;
+                s -= 8;
+                *(uint64 *)d = *(const uint64 *)s;
+            }
+        }
         while (n-- > 0)
             *--d = *--s;
     }
     else
+    {
+        if (words)
+        {
+            for (; n > 0 && (uint64)d % 8 != 0; n--)
+                *d++ = *s++;
+            for (; n >= 8; n -= 8, d += 8, s += 8)
+                *(uint64 *)d = *(const uint64 *)s;
+        }
         while (n-- > 0)
             *d++ = *s++;
+    }
 
     return dst;
 }
@@ -108,6 +108,24 @@ extern uint64 sys_force_disk_fail(void);
 /* TODO: Access Control & Symbolic Link */
 extern uint64 sys_symlink(void);
 extern uint64 sys_chmod(void);
+extern uint64 sys_openat(void);
+extern uint64 sys_fstatat(void);
+extern uint64 sys_resync_status(void);
+extern uint64 sys_raidstat(void);
+extern uint64 sys_raidverbose(void);
+extern uint64 sys_scrub_status(void);
+extern uint64 sys_raw_readv(void);
+extern uint64 sys_raw_writev(void);
+extern uint64 sys_fiemap(void);
+extern uint64 sys_usleep(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_shmget(void);
+extern uint64 sys_shmat(void);
+extern uint64 sys_futexwait(void);
+extern uint64 sys_futexwake(void);
+extern uint64 sys_uptimeus(void);
+extern uint64 sys_shmrm(void);
 
 static uint64 (*syscalls[])(void) = {
     [SYS_fork] sys_fork,
@@ -139,6 +157,24 @@ static uint64 (*syscalls[])(void) = {
     [SYS_raw_write] sys_raw_write,
     [SYS_force_disk_fail] sys_force_disk_fail,
     [SYS_chmod] sys_chmod,
+    [SYS_openat] sys_openat,
+    [SYS_fstatat] sys_fstatat,
+    [SYS_resync_status] sys_resync_status,
+    [SYS_raidstat] sys_raidstat,
+    [SYS_raidverbose] sys_raidverbose,
+    [SYS_scrub_status] sys_scrub_status,
+    [SYS_raw_readv] sys_raw_readv,
+    [SYS_raw_writev] sys_raw_writev,
+    [SYS_fiemap] sys_fiemap,
+    [SYS_usleep] sys_usleep,
+    [SYS_mmap] sys_mmap,
+    [SYS_munmap] sys_munmap,
+    [SYS_shmget] sys_shmget,
+    [SYS_shmat] sys_shmat,
+    [SYS_futexwait] sys_futexwait,
+    [SYS_futexwake] sys_futexwake,
+    [SYS_uptimeus] sys_uptimeus,
+    [SYS_shmrm] sys_shmrm,
 };
 
 void syscall(void)
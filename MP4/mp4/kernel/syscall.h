@@ -30,3 +30,21 @@
 /* TODO: Access Control & Symbolic Link */
 #define SYS_chmod 28
 #define SYS_symlink 29
+#define SYS_openat 30
+#define SYS_fstatat 31
+#define SYS_resync_status 32
+#define SYS_raidstat 33
+#define SYS_raidverbose 34
+#define SYS_scrub_status 35
+#define SYS_raw_readv 36
+#define SYS_raw_writev 37
+#define SYS_fiemap 38
+#define SYS_usleep 39
+#define SYS_mmap 40
+#define SYS_munmap 41
+#define SYS_shmget 42
+#define SYS_shmat 43
+#define SYS_futexwait 44
+#define SYS_futexwake 45
+#define SYS_uptimeus 46
+#define SYS_shmrm 47
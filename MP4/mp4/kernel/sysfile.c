@@ -12,6 +12,8 @@
 #include "file.h"
 #include "fcntl.h"
 #include "buf.h"
+#include "bdev.h"
+#include "rawio.h"
 
 #define PATH_MAX 128
 
@@ -217,6 +219,15 @@ static int isdirempty(struct inode *dp)
 {
     int off;
     struct dirent de;
+    struct dirhdr hdr;
+
+    // a hashed directory keeps its entry count in bucket 0.
+    if (dp->major)
+    {
+        if (readi(dp, 0, (uint64)&hdr, 0, sizeof(hdr)) != sizeof(hdr))
+            panic("isdirempty: readi");
+        return hdr.nentries == 0;
+    }
 
     for (off = 2 * sizeof(de); off < dp->size; off += sizeof(de))
     {
@@ -231,7 +242,6 @@ static int isdirempty(struct inode *dp)
 uint64 sys_unlink(void)
 {
     struct inode *ip, *dp;
-    struct dirent de;
     char name[DIRSIZ], path[MAXPATH];
     uint off;
 
@@ -262,9 +272,7 @@ uint64 sys_unlink(void)
         goto bad;
     }
 
-    memset(&de, 0, sizeof(de));
-    if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-        panic("unlink: writei");
+    dirunlink(dp, name, off);
     if (ip->type == T_DIR)
     {
         dp->nlink--;
@@ -315,6 +323,14 @@ static struct inode *create(char *path, short type, short major, short minor)
     ip->major = major;
 
     ip->minor = minor;
+    if (type == T_FILE)
+        ip->major = I_EXTENT;
+    if (type == T_DIR && dp->major)
+    {
+        // subdirectories of a hashed directory are hashed too.
+        ip->major = dp->major;
+        ip->size = dp->major * BSIZE;
+    }
     iupdate(ip);
 
     if (type == T_DIR)
@@ -373,6 +389,60 @@ char *kstrrchr(const char *s, char c)
     }
     return last;
 }
+// Does ip's mode allow opening it with omode?
+static int openperm(struct inode *ip, int omode)
+{
+    int wantR = !(omode & O_WRONLY);
+    int wantW = (omode & O_WRONLY) || (omode & O_RDWR);
+
+    return !(wantR && !(ip->minor & M_READ)) &&
+           !(wantW && !(ip->minor & M_WRITE)) && !(ip->type == T_DIR && wantW);
+}
+
+// Allocate a file and descriptor for the locked inode ip.
+// Unlocks ip; on failure also drops the reference and returns -1.
+// Caller must be inside a transaction.
+static int openinode(struct inode *ip, int omode)
+{
+    struct file *f;
+    int fd;
+
+    if (ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV))
+    {
+        iunlockput(ip);
+        return -1;
+    }
+
+    if ((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0)
+    {
+        if (f)
+            fileclose(f);
+        iunlockput(ip);
+        return -1;
+    }
+
+    f->type = (ip->type == T_DEVICE ? FD_DEVICE : FD_INODE);
+    f->major = ip->major;
+    f->ip = ip;
+    f->off = 0;
+
+    if ((omode & O_NOACCESS) && ip->type != T_SYMLINK)
+    {
+        f->readable = f->writable = 0;
+    }
+    else
+    {
+        f->readable = !(omode & O_WRONLY);
+        f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+    }
+
+    if ((omode & O_TRUNC) && ip->type == T_FILE)
+        itrunc(ip);
+
+    iunlock(ip);
+    return fd;
+}
+
 uint64 sys_open(void)
 {
     char path[MAXPATH];
@@ -386,7 +456,6 @@ uint64 sys_open(void)
     for (int depth = 0; depth < 10; depth++)
     {
         struct inode *ip;
-        struct file *f;
         int fd;
 
         begin_op();
@@ -497,71 +566,118 @@ uint64 sys_open(void)
             }
 
             // ---------- (2d) 權限檢查 (若非 O_NOACCESS) ----------
-            if (!(omode & O_NOACCESS))
+            if (!(omode & O_NOACCESS) && !openperm(ip, omode))
             {
-                int wantR = !(omode & O_WRONLY);
-                int wantW = (omode & O_WRONLY) || (omode & O_RDWR);
-                int ok = !(wantR && !(ip->minor & M_READ)) &&
-                         !(wantW && !(ip->minor & M_WRITE)) &&
-                         !(ip->type == T_DIR && wantW);
-                if (!ok)
-                {
-                    iunlockput(ip);
-                    end_op();
-                    return -1;
-                }
+                iunlockput(ip);
+                end_op();
+                return -1;
             }
         }
 
-        // ───────────────────── 3) 特殊裝置號檢查
-        // ───────────────────────────────
-        if (ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV))
+        // ───────────────────── 3) ~ 5) 配置 fd 並初始化 file 結構
+        // ─────────────────────────────
+        fd = openinode(ip, omode);
+        end_op();
+        return fd;
+
+    loop_continue:; // label target；什麼都不做，for 迴圈會繼續
+    }
+
+    // 超過 symlink 深度限制
+    return -1;
+}
+
+// Fetch a directory file descriptor argument for the *at() calls.
+static int argdirfd(int n, struct file **pf)
+{
+    struct file *f;
+
+    if (argfd(n, 0, &f) < 0 || f->type != FD_INODE)
+        return -1;
+    *pf = f;
+    return 0;
+}
+
+// Like open(), but a relative path is resolved from the directory
+// open as dirfd instead of the current directory, so tree walkers
+// pay one dirlookup per entry rather than a walk from the root.
+// Creation and O_NOACCESS are left to open().
+uint64 sys_openat(void)
+{
+    char path[MAXPATH];
+    int omode, fd;
+    struct file *df;
+    struct inode *ip;
+
+    if (argdirfd(0, &df) < 0 || argstr(1, path, MAXPATH) < 0 ||
+        argint(2, &omode) < 0)
+        return -1;
+    if (omode & (O_CREATE | O_NOACCESS))
+        return -1;
+
+    for (int depth = 0; depth < SYMLOOP_MAX; depth++)
+    {
+        begin_op();
+        if ((ip = nameiat(df->ip, path)) == 0)
         {
-            iunlockput(ip);
             end_op();
             return -1;
         }
+        ilock(ip);
 
-        // ───────────────────── 4) 配置 file 與 fd
-        // ──────────────────────────────
-        if ((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0)
+        if (ip->type == T_SYMLINK)
         {
-            if (f)
-                fileclose(f);
+            int n = readi(ip, 0, (uint64)path, 0, MAXPATH - 1);
             iunlockput(ip);
             end_op();
-            return -1;
+            if (n < 0)
+                return -1;
+            path[n] = 0;
+            continue;
         }
 
-        // ───────────────────── 5) 初始化 file 結構
-        // ─────────────────────────────
-        f->type = (ip->type == T_DEVICE ? FD_DEVICE : FD_INODE);
-        f->major = ip->major;
-        f->ip = ip;
-        f->off = 0;
-
-        if ((omode & O_NOACCESS) && ip->type != T_SYMLINK)
-        {
-            f->readable = f->writable = 0;
-        }
-        else
+        if (!openperm(ip, omode))
         {
-            f->readable = !(omode & O_WRONLY);
-            f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+            iunlockput(ip);
+            end_op();
+            return -1;
         }
 
-        if ((omode & O_TRUNC) && ip->type == T_FILE)
-            itrunc(ip);
-
-        iunlock(ip);
+        fd = openinode(ip, omode);
         end_op();
         return fd;
+    }
+    return -1;
+}
 
-    loop_continue:; // label target；什麼都不做，for 迴圈會繼續
+// Like stat(), but a relative path is resolved from the directory
+// open as dirfd.
+uint64 sys_fstatat(void)
+{
+    char path[MAXPATH];
+    uint64 addr;
+    struct file *df;
+    struct inode *ip;
+    struct stat st;
+
+    if (argdirfd(0, &df) < 0 || argstr(1, path, MAXPATH) < 0 ||
+        argaddr(2, &addr) < 0)
+        return -1;
+
+    begin_op();
+    if ((ip = nameiat(df->ip, path)) == 0)
+    {
+        end_op();
+        return -1;
     }
+    ilock(ip);
+    stati(ip, &st);
+    iunlockput(ip);
+    end_op();
 
-    // 超過 symlink 深度限制
-    return -1;
+    if (copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+        return -1;
+    return 0;
 }
 
 uint64 sys_mkdir(void)
@@ -750,39 +866,95 @@ uint64 sys_symlink(void)
     return 0;
 }
 
-uint64 sys_raw_read(void)
+// Can raw I/O of the disk block at pb use the cache? Only if pb holds
+// the first copy of a logical block lbn, which bread and bwrite keep in
+// step with lbn's clean buffer, and resync is not still behind on it.
+static int cacheable(struct pblock *pb, uint *lbn)
 {
-    int pbn;
-    uint64 user_buf_addr;
-    struct buf *b;
+    struct pblock first;
 
-    if (argint(0, &pbn) < 0 || argaddr(1, &user_buf_addr) < 0)
+    return bdev_logical(pb, lbn) && bdev_locate(*lbn, 0, &first) &&
+           first.disk == pb->disk && first.blockno == pb->blockno &&
+           !raid_stale(*lbn, 0);
+}
+
+// Move n blocks between the user buffers at ubuf[] and the disk blocks
+// pb[]. Unless nocache is set, a block read through a cacheable block
+// whose buffer is valid and clean is copied from that buffer. The rest
+// go through bounce buffers, queued to the disks all at once, and the
+// logical block of each block written is dropped from the cache.
+static int rawio(struct pblock *pb, uint64 *ubuf, int n, int write,
+                 int nocache)
+{
+    struct proc *p = myproc();
+    struct pblock go[MAXRAWV];
+    struct buf *bs[MAXRAWV], *b;
+    int from[MAXRAWV]; // index in pb[] of go[i]
+    int ngo = 0, r = -1;
+    uint lbn;
+
+    bsync(); // so the disk holds what has been committed
+    for (int i = 0; i < n; i++)
     {
-        return -1;
+        if (!write && !nocache && cacheable(&pb[i], &lbn) &&
+            (b = bpeek(ROOTDEV, lbn)) != 0)
+        {
+            r = copyout(p->pagetable, ubuf[i], (char *)b->data, BSIZE);
+            brelse(b);
+            if (r < 0)
+                goto out;
+            continue;
+        }
+        if ((bs[ngo] = (struct buf *)kalloc()) == 0)
+            goto out;
+        go[ngo] = pb[i];
+        from[ngo++] = i;
+        if (write && copyin(p->pagetable, (char *)bs[ngo - 1]->data, ubuf[i],
+                            BSIZE) < 0)
+            goto out;
     }
-
-    if (pbn < 0 || pbn >= FSSIZE)
+    r = -1;
+    if (ngo > 0 && virtio_disk_rwb(bs, go, ngo, write) != 0)
+        goto out;
+    for (int i = 0; i < ngo; i++)
     {
-        return -1;
+        if (write)
+        {
+            if (bdev_logical(&go[i], &lbn))
+                binval(ROOTDEV, lbn);
+        }
+        else if (copyout(p->pagetable, ubuf[from[i]], (char *)bs[i]->data,
+                         BSIZE) < 0)
+            goto out;
     }
+    r = 0;
+
+out:
+    for (int i = 0; i < ngo; i++)
+        kfree(bs[i]);
+    return r;
+}
 
-    b = bget(ROOTDEV, pbn);
-    if (b == 0)
+uint64 sys_raw_read(void)
+{
+    int pbn;
+    uint64 user_buf_addr;
+    struct pblock pb;
+
+    if (argint(0, &pbn) < 0 || argaddr(1, &user_buf_addr) < 0)
     {
         return -1;
     }
 
-    virtio_disk_rw(b, 0);
-
-    struct proc *p = myproc();
-    if (copyout(p->pagetable, user_buf_addr, (char *)b->data, BSIZE) < 0)
+    if (pbn < 0 || pbn >= FSSIZE)
     {
-        brelse(b);
         return -1;
     }
 
-    brelse(b);
-    return 0;
+    vma_prefault(user_buf_addr, BSIZE, 1);
+    pb.disk = 0;
+    pb.blockno = pbn;
+    return rawio(&pb, &user_buf_addr, 1, 0, 0);
 }
 
 uint64 sys_get_disk_lbn(void)
@@ -813,11 +985,50 @@ uint64 sys_get_disk_lbn(void)
     return (uint64)disk_lbn;
 }
 
+#define NFEXT 32 // extents collected per pass
+
+// fiemap(fd, start, ext, max): copy to ext up to max extents of fd's
+// blocks from file block start on. Returns how many; if that is max,
+// call again from the end of the last one for the rest.
+uint64 sys_fiemap(void)
+{
+    struct file *f;
+    struct fextent ext[NFEXT];
+    uint64 addr;
+    int start, max, n, done = 0;
+
+    if (argfd(0, 0, &f) < 0 || argint(1, &start) < 0 ||
+        argaddr(2, &addr) < 0 || argint(3, &max) < 0)
+        return -1;
+    if (f->type != FD_INODE || start < 0 || max < 0)
+        return -1;
+
+    vma_prefault(addr, (uint64)max * sizeof(ext[0]), 1);
+    ilock(f->ip);
+    while (done < max)
+    {
+        n = iextents(f->ip, start, ext, max - done < NFEXT ? max - done : NFEXT);
+        if (n > 0 && copyout(myproc()->pagetable,
+                             addr + done * sizeof(ext[0]), (char *)ext,
+                             n * sizeof(ext[0])) < 0)
+        {
+            iunlock(f->ip);
+            return -1;
+        }
+        done += n;
+        if (n < NFEXT)
+            break;
+        start = ext[n - 1].lbn + ext[n - 1].len;
+    }
+    iunlock(f->ip);
+    return done;
+}
+
 uint64 sys_raw_write(void)
 {
     int pbn;
     uint64 user_buf_addr;
-    struct buf *b;
+    struct pblock pb;
 
     if (argint(0, &pbn) < 0 || argaddr(1, &user_buf_addr) < 0)
     {
@@ -829,25 +1040,48 @@ uint64 sys_raw_write(void)
         return -1;
     }
 
-    b = bget(ROOTDEV, pbn);
-    if (b == 0)
-    {
-        printf("sys_raw_write: bget failed for PBN %d\n", pbn);
-        return -1;
-    }
+    vma_prefault(user_buf_addr, BSIZE, 0);
+    pb.disk = 0;
+    pb.blockno = pbn;
+    return rawio(&pb, &user_buf_addr, 1, 1, 0);
+}
+
+// raw_readv(vec, n, flags) and raw_writev(vec, n, flags): move n
+// blocks, at most MAXRAWV, between user buffers and the disks, as
+// rawio does. RAW_NOCACHE keeps reads from using the cache.
+static int rawv(int write)
+{
     struct proc *p = myproc();
-    if (copyin(p->pagetable, (char *)b->data, user_buf_addr, BSIZE) < 0)
-    {
-        brelse(b);
+    struct rawvec v[MAXRAWV];
+    struct pblock pb[MAXRAWV];
+    uint64 ubuf[MAXRAWV];
+    uint64 addr;
+    int n, flags;
+
+    if (argaddr(0, &addr) < 0 || argint(1, &n) < 0 || argint(2, &flags) < 0)
+        return -1;
+    if (n >= 1 && n <= MAXRAWV)
+        vma_prefault(addr, n * sizeof(v[0]), 0);
+    if (n < 1 || n > MAXRAWV ||
+        copyin(p->pagetable, (char *)v, addr, n * sizeof(v[0])) < 0)
         return -1;
+    for (int i = 0; i < n; i++)
+    {
+        if (v[i].pbn >= FSSIZE || !virtio_disk_present(v[i].disk) ||
+            (!(flags & RAW_NOCACHE) && v[i].disk != 0))
+            return -1;
+        pb[i].disk = v[i].disk;
+        pb[i].blockno = v[i].pbn;
+        ubuf[i] = (uint64)v[i].buf;
     }
+    for (int i = 0; i < n; i++)
+        vma_prefault(ubuf[i], BSIZE, !write);
+    return rawio(pb, ubuf, n, write, flags & RAW_NOCACHE);
+}
 
-    b->valid = 1;
-    virtio_disk_rw(b, 1);
-    brelse(b);
+uint64 sys_raw_readv(void) { return rawv(0); }
 
-    return 0;
-}
+uint64 sys_raw_writev(void) { return rawv(1); }
 
 static int chmod_walk(char *path, int add, int bits, int recursive)
 {
@@ -955,3 +1189,30 @@ uint64 sys_chmod(void)
 
     return 0;
 }
+
+// void *mmap(void *addr, int len, int prot, int flags, int fd, int off)
+// addr is only a hint, which this kernel ignores.
+uint64 sys_mmap(void)
+{
+    uint64 addr;
+    int len, prot, flags, off;
+    struct file *f;
+
+    if (argaddr(0, &addr) < 0 || argint(1, &len) < 0 ||
+        argint(2, &prot) < 0 || argint(3, &flags) < 0 ||
+        argfd(4, 0, &f) < 0 || argint(5, &off) < 0)
+        return -1;
+    if (len <= 0 || off < 0)
+        return -1;
+    return mmap(f, len, prot, flags, off);
+}
+
+uint64 sys_munmap(void)
+{
+    uint64 addr;
+    int len;
+
+    if (argaddr(0, &addr) < 0 || argint(1, &len) < 0 || len <= 0)
+        return -1;
+    return munmap(addr, len);
+}
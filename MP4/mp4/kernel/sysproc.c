@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "fs.h"
+#include "raid.h"
 
 uint64 sys_exit(void)
 {
@@ -44,23 +46,20 @@ uint64 sys_sbrk(void)
 uint64 sys_sleep(void)
 {
     int n;
-    uint ticks0;
 
-    if (argint(0, &n) < 0)
+    if (argint(0, &n) < 0 || n < 0)
         return -1;
-    acquire(&tickslock);
-    ticks0 = ticks;
-    while (ticks - ticks0 < n)
-    {
-        if (myproc()->killed)
-        {
-            release(&tickslock);
-            return -1;
-        }
-        sleep(&ticks, &tickslock);
-    }
-    release(&tickslock);
-    return 0;
+    return sleepuntil(timer_now() + (uint64)n * TICKCYCLES);
+}
+
+// Sleep for n microseconds.
+uint64 sys_usleep(void)
+{
+    int n;
+
+    if (argint(0, &n) < 0 || n < 0)
+        return -1;
+    return sleepuntil(timer_now() + (uint64)n * USCYCLES);
 }
 
 uint64 sys_kill(void)
@@ -84,9 +83,13 @@ uint64 sys_uptime(void)
     return xticks;
 }
 
+// microseconds since boot, for timing what takes less than a tick.
+uint64 sys_uptimeus(void) { return timer_now() / USCYCLES; }
+
 // --- RAID 1 Test Hook Syscall ---
 extern int force_read_error_pbn;
 extern int force_disk_fail_id;
+extern int raid_verbose; // print BW_DIAG lines, for the tests below
 
 // System call to simulate a read error on a specific physical block of Disk 0.
 // Argument: pbn - the physical block number (0 to LOGICAL_DISK_SIZE-1) to fail,
@@ -100,7 +103,10 @@ uint64 sys_force_fail(void)
     if (pbn >= LOGICAL_DISK_SIZE || pbn < -1)
         return -1;
 
+    bsync(); // write what was committed under the old setting
     force_read_error_pbn = pbn;
+    raid_verbose = 1;
+    raid_kick();
     return 0;
 }
 
@@ -115,8 +121,113 @@ uint64 sys_force_disk_fail(void)
         return -1;
     if (disk_id < -1 || disk_id > 1)
         return -1;
+    bsync(); // write what was committed under the old setting
     force_disk_fail_id = disk_id;
+    raid_verbose = 1;
+    raid_kick();
+    return 0;
+}
+
+// System call to report RAID-1 resync progress into a struct resyncstat.
+uint64 sys_resync_status(void)
+{
+    uint64 addr;
+    struct resyncstat st;
+
+    if (argaddr(0, &addr) < 0)
+        return -1;
+    raid_status(&st);
+    if (copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+        return -1;
+    return 0;
+}
+
+// System call to report scrubber progress into a struct scrubstat.
+uint64 sys_scrub_status(void)
+{
+    uint64 addr;
+    struct scrubstat st;
+
+    if (argaddr(0, &addr) < 0)
+        return -1;
+    scrub_status(&st);
+    if (copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+        return -1;
+    return 0;
+}
+
+// System call to copy RAID-1 event counters and recent events into a
+// struct raidstat.
+uint64 sys_raidstat(void)
+{
+    uint64 addr;
+
+    if (argaddr(0, &addr) < 0)
+        return -1;
+    return raid_stat(addr);
+}
+
+// System call to turn BW_DIAG/BW_ACTION printing on (1) or off (0).
+uint64 sys_raidverbose(void)
+{
+    int on;
+
+    if (argint(0, &on) < 0)
+        return -1;
+    raid_verbose = on != 0;
     return 0;
 }
 
 // --- End RAID 1 Test Hook Syscall ---
+
+// int shmget(int key, int size)
+uint64 sys_shmget(void)
+{
+    int key, size;
+
+    if (argint(0, &key) < 0 || argint(1, &size) < 0 || size <= 0)
+        return -1;
+    return shmget(key, size);
+}
+
+// void *shmat(int id); munmap detaches it.
+uint64 sys_shmat(void)
+{
+    int id;
+
+    if (argint(0, &id) < 0)
+        return -1;
+    return shmat(id);
+}
+
+// int shmrm(int id)
+uint64 sys_shmrm(void)
+{
+    int id;
+
+    if (argint(0, &id) < 0)
+        return -1;
+    return shmrm(id);
+}
+
+// int futexwait(int *addr, int val)
+uint64 sys_futexwait(void)
+{
+    uint64 addr;
+    int val;
+
+    if (argaddr(0, &addr) < 0 || argint(1, &val) < 0)
+        return -1;
+    return futexwait(addr, val);
+}
+
+// int futexwake(int *addr, int n)
+uint64 sys_futexwake(void)
+{
+    uint64 addr;
+    int n;
+
+    if (argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+        return -1;
+    return futexwake(addr, n);
+}
@@ -0,0 +1,179 @@
+// Deadline timers.
+//
+// Each hart keeps the processes sleeping until a given time on a list
+// sorted by deadline, and programs its CLINT compare register for the
+// earlier of the first deadline and its next tick. timervec in
+// kernelvec.S just disarms the timer and passes the interrupt on to
+// timerintr, so a sleeping process causes no interrupts before it is
+// due.
+//
+// A hart with nothing to run stops its tick and waits for its next
+// deadline, except hart 0, which keeps ticks going for uptime() and
+// the kernel threads that sleep on it.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+struct timerq
+{
+    struct spinlock lock;
+    struct proc *head; // sleepers, earliest wakeat first
+    uint64 nexttick;   // when the next tick is due
+    int idle;          // has this hart stopped its tick?
+};
+
+static struct timerq timerqs[NCPU];
+
+void timerqinit(void)
+{
+    for (int i = 0; i < NCPU; i++)
+        initlock(&timerqs[i].lock, "timerq");
+}
+
+uint64 timer_now(void) { return *(uint64 *)CLINT_MTIME; }
+
+// Program this hart's next timer interrupt. Caller holds tq->lock.
+static void program(struct timerq *tq)
+{
+    uint64 next = -1;
+
+    if (tq->head)
+        next = tq->head->wakeat;
+    if ((!tq->idle || cpuid() == 0) && tq->nexttick < next)
+        next = tq->nexttick;
+    *(uint64 *)CLINT_MTIMECMP(cpuid()) = next;
+}
+
+// Take p off the list it sleeps on, unless timerintr already has.
+static void tqremove(struct proc *p)
+{
+    struct timerq *tq = p->tq;
+    struct proc **pp;
+
+    if (tq == 0)
+        return;
+    acquire(&tq->lock);
+    for (pp = &tq->head; *pp != 0; pp = &(*pp)->tnext)
+    {
+        if (*pp == p)
+        {
+            *pp = p->tnext;
+            break;
+        }
+    }
+    p->tq = 0;
+    release(&tq->lock);
+}
+
+// Sleep until the timer reads when. Returns -1 if killed first.
+int sleepuntil(uint64 when)
+{
+    struct proc *p = myproc(), **pp;
+    struct timerq *tq;
+    int r = 0;
+
+    // p->lock keeps interrupts off, so p stays on this hart until
+    // sleep, and timerintr cannot wake p before it sleeps.
+    acquire(&p->lock);
+    while (timer_now() < when)
+    {
+        if (p->killed)
+        {
+            r = -1;
+            break;
+        }
+        tq = &timerqs[cpuid()];
+        acquire(&tq->lock);
+        for (pp = &tq->head; *pp != 0 && (*pp)->wakeat <= when;
+             pp = &(*pp)->tnext)
+            ;
+        p->wakeat = when;
+        p->tnext = *pp;
+        *pp = p;
+        p->tq = tq;
+        if (tq->head == p)
+            program(tq);
+        release(&tq->lock);
+
+        sleep(&p->wakeat, &p->lock);
+        tqremove(p);
+    }
+    release(&p->lock);
+    return r;
+}
+
+// A timer interrupt on this hart: wake the sleepers that are due, and
+// program the next interrupt. Returns 1 if a tick was due, so that the
+// caller preempts the running process.
+int timerintr(void)
+{
+    struct timerq *tq = &timerqs[cpuid()];
+    struct proc *p;
+    uint64 now = timer_now();
+    int tick = 0;
+
+    for (;;)
+    {
+        acquire(&tq->lock);
+        if ((p = tq->head) != 0 && p->wakeat <= now)
+        {
+            tq->head = p->tnext;
+            p->tq = 0;
+        }
+        else
+            p = 0;
+        release(&tq->lock);
+        if (p == 0)
+            break;
+        wakeup(&p->wakeat);
+    }
+
+    acquire(&tq->lock);
+    if (now >= tq->nexttick)
+    {
+        tick = 1;
+        tq->nexttick = (now / TICKCYCLES + 1) * TICKCYCLES;
+    }
+    program(tq);
+    release(&tq->lock);
+
+    if (tick && cpuid() == 0)
+        clockintr();
+    return tick;
+}
+
+// More was queued on this hart than it can run next: wake a hart that
+// has stopped its tick, so that it can steal some. Any hart's compare
+// register can be written, and 0 makes its timer fire at once.
+void timer_kick(void)
+{
+    int me = cpuid();
+
+    for (int i = 0; i < NCPU; i++)
+    {
+        if (i != me && timerqs[i].idle)
+        {
+            *(uint64 *)CLINT_MTIMECMP(i) = 0;
+            return;
+        }
+    }
+}
+
+// The scheduler found nothing to run (idle = 1), or found something
+// after that (idle = 0). Stop or restart this hart's tick.
+void timer_idle(int idle)
+{
+    struct timerq *tq = &timerqs[cpuid()];
+
+    acquire(&tq->lock);
+    tq->idle = idle;
+    if (!idle)
+        tq->nexttick = (timer_now() / TICKCYCLES + 1) * TICKCYCLES;
+    program(tq);
+    release(&tq->lock);
+}
@@ -58,6 +58,20 @@ void usertrap(void)
 
         syscall();
     }
+    else if (r_scause() == 15 && uvmcow(p->pagetable, r_stval()) == 0)
+    {
+        // store to a copy-on-write page, which now has its own copy.
+    }
+    else if ((r_scause() == 13 || r_scause() == 15) &&
+             uvmlazy(p->pagetable, p->sz, r_stval()) == 0)
+    {
+        // first touch of a heap page that sbrk did not allocate.
+    }
+    else if ((r_scause() == 13 || r_scause() == 15) &&
+             vma_fault(r_stval(), r_scause() == 15, 1) == 0)
+    {
+        // first touch of a page of a mapped file.
+    }
     else if ((which_dev = devintr()) != 0)
     {
         // ok
@@ -74,7 +88,7 @@ void usertrap(void)
 
     // give up the CPU if this is a timer interrupt.
     if (which_dev == 2)
-        yield();
+        preempt();
 
     usertrapret();
 }
@@ -146,9 +160,9 @@ void kerneltrap()
 
     // give up the CPU if this is a timer interrupt.
     if (which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-        yield();
+        preempt();
 
-    // the yield() may have caused some traps to occur,
+    // the preempt() may have caused some traps to occur,
     // so restore trap registers for use by kernelvec.S's sepc instruction.
     w_sepc(sepc);
     w_sstatus(sstatus);
@@ -182,9 +196,9 @@ int devintr()
         {
             uartintr();
         }
-        else if (irq == VIRTIO0_IRQ)
+        else if (irq >= VIRTIO0_IRQ && irq < VIRTIO0_IRQ + NDISK)
         {
-            virtio_disk_intr();
+            virtio_disk_intr(irq - VIRTIO0_IRQ);
         }
         else if (irq)
         {
@@ -204,16 +218,13 @@ int devintr()
         // software interrupt from a machine-mode timer interrupt,
         // forwarded by timervec in kernelvec.S.
 
-        if (cpuid() == 0)
-        {
-            clockintr();
-        }
-
         // acknowledge the software interrupt by clearing
-        // the SSIP bit in sip.
+        // the SSIP bit in sip, before timerintr() programs
+        // the next one, which may already be due.
         w_sip(r_sip() & ~2);
 
-        return 2;
+        // only ticks preempt; a deadline is like another device.
+        return timerintr() ? 2 : 1;
     }
     else
     {
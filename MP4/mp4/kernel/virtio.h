@@ -45,8 +45,10 @@
 #define VIRTIO_RING_F_EVENT_IDX 29
 
 // this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// must be a power of two, and at most 128 so that the
+// descriptors and avail ring fit in the first page.
+#define NUM 64
+#define MAXRWV 16 // most requests per virtio_disk_rwv call
 
 struct VRingDesc
 {
@@ -16,10 +16,11 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "bdev.h"
 #include "virtio.h"
 
-// the address of virtio mmio register r.
-#define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
+// the address of virtio mmio register r of disk d.
+#define R(d, r) ((volatile uint32 *)(VIRTIO(d) + (r)))
 
 static struct disk
 {
@@ -43,33 +44,37 @@ static struct disk
     {
         struct buf *b;
         char status;
+        char done;
     } info[NUM];
 
     struct spinlock vdisk_lock;
+    int present;
 
-} __attribute__((aligned(PGSIZE))) disk;
+} __attribute__((aligned(PGSIZE))) disks[NDISK];
 
-void virtio_disk_init(void)
+static int probe(int d)
+{
+    return *R(d, VIRTIO_MMIO_MAGIC_VALUE) == 0x74726976 &&
+           *R(d, VIRTIO_MMIO_VERSION) == 1 &&
+           *R(d, VIRTIO_MMIO_DEVICE_ID) == 2 &&
+           *R(d, VIRTIO_MMIO_VENDOR_ID) == 0x554d4551;
+}
+
+static void init1(int d)
 {
+    struct disk *disk = &disks[d];
     uint32 status = 0;
 
-    initlock(&disk.vdisk_lock, "virtio_disk");
-
-    if (*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
-        *R(VIRTIO_MMIO_VERSION) != 1 || *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
-        *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551)
-    {
-        panic("could not find virtio disk");
-    }
+    initlock(&disk->vdisk_lock, "virtio_disk");
 
     status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
-    *R(VIRTIO_MMIO_STATUS) = status;
+    *R(d, VIRTIO_MMIO_STATUS) = status;
 
     status |= VIRTIO_CONFIG_S_DRIVER;
-    *R(VIRTIO_MMIO_STATUS) = status;
+    *R(d, VIRTIO_MMIO_STATUS) = status;
 
     // negotiate features
-    uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+    uint64 features = *R(d, VIRTIO_MMIO_DEVICE_FEATURES);
     features &= ~(1 << VIRTIO_BLK_F_RO);
     features &= ~(1 << VIRTIO_BLK_F_SCSI);
     features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
@@ -77,52 +82,66 @@ void virtio_disk_init(void)
     features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
     features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
     features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
-    *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+    *R(d, VIRTIO_MMIO_DRIVER_FEATURES) = features;
 
     // tell device that feature negotiation is complete.
     status |= VIRTIO_CONFIG_S_FEATURES_OK;
-    *R(VIRTIO_MMIO_STATUS) = status;
+    *R(d, VIRTIO_MMIO_STATUS) = status;
 
     // tell device we're completely ready.
     status |= VIRTIO_CONFIG_S_DRIVER_OK;
-    *R(VIRTIO_MMIO_STATUS) = status;
+    *R(d, VIRTIO_MMIO_STATUS) = status;
 
-    *R(VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
+    *R(d, VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
 
     // initialize queue 0.
-    *R(VIRTIO_MMIO_QUEUE_SEL) = 0;
-    uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+    *R(d, VIRTIO_MMIO_QUEUE_SEL) = 0;
+    uint32 max = *R(d, VIRTIO_MMIO_QUEUE_NUM_MAX);
     if (max == 0)
         panic("virtio disk has no queue 0");
     if (max < NUM)
         panic("virtio disk max queue too short");
-    *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
-    memset(disk.pages, 0, sizeof(disk.pages));
-    *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
+    *R(d, VIRTIO_MMIO_QUEUE_NUM) = NUM;
+    memset(disk->pages, 0, sizeof(disk->pages));
+    *R(d, VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk->pages) >> PGSHIFT;
 
     // desc = pages -- num * VRingDesc
     // avail = pages + 0x40 -- 2 * uint16, then num * uint16
     // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
 
-    disk.desc = (struct VRingDesc *)disk.pages;
-    disk.avail =
-        (uint16 *)(((char *)disk.desc) + NUM * sizeof(struct VRingDesc));
-    disk.used = (struct UsedArea *)(disk.pages + PGSIZE);
+    disk->desc = (struct VRingDesc *)disk->pages;
+    disk->avail =
+        (uint16 *)(((char *)disk->desc) + NUM * sizeof(struct VRingDesc));
+    disk->used = (struct UsedArea *)(disk->pages + PGSIZE);
 
     for (int i = 0; i < NUM; i++)
-        disk.free[i] = 1;
+        disk->free[i] = 1;
+
+    disk->present = 1;
+}
+
+// Set up every virtio disk qemu attached; disk 0 is required.
+void virtio_disk_init(void)
+{
+    if (!probe(0))
+        panic("could not find virtio disk");
+    for (int d = 0; d < NDISK; d++)
+        if (probe(d))
+            init1(d);
 
-    // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
+    // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ + d.
 }
 
+int virtio_disk_present(int d) { return d >= 0 && d < NDISK && disks[d].present; }
+
 // find a free descriptor, mark it non-free, return its index.
-static int alloc_desc()
+static int alloc_desc(struct disk *disk)
 {
     for (int i = 0; i < NUM; i++)
     {
-        if (disk.free[i])
+        if (disk->free[i])
         {
-            disk.free[i] = 0;
+            disk->free[i] = 0;
             return i;
         }
     }
@@ -130,148 +149,227 @@ static int alloc_desc()
 }
 
 // mark a descriptor as free.
-static void free_desc(int i)
+static void free_desc(struct disk *disk, int i)
 {
     if (i >= NUM)
         panic("virtio_disk_intr 1");
-    if (disk.free[i])
+    if (disk->free[i])
         panic("virtio_disk_intr 2");
-    disk.desc[i].addr = 0;
-    disk.free[i] = 1;
-    wakeup(&disk.free[0]);
+    disk->desc[i].addr = 0;
+    disk->free[i] = 1;
+    wakeup(&disk->free[0]);
 }
 
 // free a chain of descriptors.
-static void free_chain(int i)
+static void free_chain(struct disk *disk, int i)
 {
     while (1)
     {
-        free_desc(i);
-        if (disk.desc[i].flags & VRING_DESC_F_NEXT)
-            i = disk.desc[i].next;
+        free_desc(disk, i);
+        if (disk->desc[i].flags & VRING_DESC_F_NEXT)
+            i = disk->desc[i].next;
         else
             break;
     }
 }
 
-static int alloc3_desc(int *idx)
+// allocate n descriptors, all or none.
+static int allocn_desc(struct disk *disk, int *idx, int n)
 {
-    for (int i = 0; i < 3; i++)
+    for (int i = 0; i < n; i++)
     {
-        idx[i] = alloc_desc();
+        idx[i] = alloc_desc(disk);
         if (idx[i] < 0)
         {
             for (int j = 0; j < i; j++)
-                free_desc(idx[j]);
+                free_desc(disk, idx[j]);
             return -1;
         }
     }
     return 0;
 }
 
-void virtio_disk_rw(struct buf *b, int write)
+// the spec says that legacy block operations use three
+// descriptors: one for type/reserved/sector, one for
+// the data, one for a 1-byte status result.
+struct virtio_blk_outhdr
+{
+    uint32 type;
+    uint32 reserved;
+    uint64 sector;
+};
+
+// Queue the requests of pb[] that are for disk d, whose indices are
+// in which[0..n-1]. Request i transfers b[i]->data. Their first
+// descriptors go in head[].
+static void submit(int d, struct buf **b, struct pblock *pb, int *which, int n,
+                   int write, struct virtio_blk_outhdr *buf0, int *head)
 {
-    uint64 sector = b->blockno * (BSIZE / 512);
+    struct disk *disk = &disks[d];
+    int idx[3 * MAXRWV];
 
-    acquire(&disk.vdisk_lock);
+    if (3 * n > NUM)
+        panic("virtio_disk_rwv: too many requests for one disk");
 
-    // the spec says that legacy block operations use three
-    // descriptors: one for type/reserved/sector, one for
-    // the data, one for a 1-byte status result.
+    acquire(&disk->vdisk_lock);
 
-    // allocate the three descriptors.
-    int idx[3];
+    // allocate the descriptors for all n requests at once, so that
+    // two callers cannot each hold part of what the other needs.
     while (1)
     {
-        if (alloc3_desc(idx) == 0)
+        if (allocn_desc(disk, idx, 3 * n) == 0)
         {
             break;
         }
-        sleep(&disk.free[0], &disk.vdisk_lock);
+        sleep(&disk->free[0], &disk->vdisk_lock);
+    }
+
+    for (int j = 0; j < n; j++)
+    {
+        int i = which[j], *c = &idx[3 * j];
+
+        // format the three descriptors.
+        // qemu's virtio-blk.c reads them.
+        if (write)
+            buf0[i].type = VIRTIO_BLK_T_OUT; // write the disk
+        else
+            buf0[i].type = VIRTIO_BLK_T_IN; // read the disk
+        buf0[i].reserved = 0;
+        buf0[i].sector = pb[i].blockno * (BSIZE / 512);
+
+        // buf0 is on a kernel stack, which is not direct mapped,
+        // thus the call to kvmpa().
+        disk->desc[c[0]].addr = (uint64)kvmpa((uint64)&buf0[i]);
+        disk->desc[c[0]].len = sizeof(buf0[i]);
+        disk->desc[c[0]].flags = VRING_DESC_F_NEXT;
+        disk->desc[c[0]].next = c[1];
+
+        disk->desc[c[1]].addr = (uint64)b[i]->data;
+        disk->desc[c[1]].len = BSIZE;
+        if (write)
+            disk->desc[c[1]].flags = 0; // device reads b[i]->data
+        else
+            disk->desc[c[1]].flags = VRING_DESC_F_WRITE; // device writes it
+        disk->desc[c[1]].flags |= VRING_DESC_F_NEXT;
+        disk->desc[c[1]].next = c[2];
+
+        disk->info[c[0]].status = 0;
+        disk->desc[c[2]].addr = (uint64)&disk->info[c[0]].status;
+        disk->desc[c[2]].len = 1;
+        disk->desc[c[2]].flags = VRING_DESC_F_WRITE; // device writes the status
+        disk->desc[c[2]].next = 0;
+
+        // record struct buf for virtio_disk_intr().
+        disk->info[c[0]].b = b[i];
+        disk->info[c[0]].done = 0;
+        head[i] = c[0];
+
+        // avail[0] is flags
+        // avail[1] tells the device how far to look in avail[2...].
+        // avail[2...] are desc[] indices the device should process.
+        // we only tell device the first index in our chain of descriptors.
+        disk->avail[2 + (disk->avail[1] % NUM)] = c[0];
+        __sync_synchronize();
+        disk->avail[1] = disk->avail[1] + 1;
     }
 
-    // format the three descriptors.
-    // qemu's virtio-blk.c reads them.
+    *R(d, VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
-    struct virtio_blk_outhdr
+    release(&disk->vdisk_lock);
+}
+
+// Transfer b[i]->data to or from block pb[i], for each of n requests
+// that may be on different disks. All n requests are queued before
+// waiting for any, so they proceed in parallel. The bufs' blockno is
+// not used, and a buf may appear more than once. Returns a mask with
+// bit i set if request i failed.
+int virtio_disk_rwb(struct buf **b, struct pblock *pb, int n, int write)
+{
+    struct virtio_blk_outhdr buf0[MAXRWV];
+    int head[MAXRWV], which[MAXRWV], failed = 0;
+
+    if (n < 1 || n > MAXRWV)
+        panic("virtio_disk_rwb");
+
+    for (int i = 0; i < n; i++)
+        b[i]->disk = 1;
+    for (int d = 0; d < NDISK; d++)
     {
-        uint32 type;
-        uint32 reserved;
-        uint64 sector;
-    } buf0;
-
-    if (write)
-        buf0.type = VIRTIO_BLK_T_OUT; // write the disk
-    else
-        buf0.type = VIRTIO_BLK_T_IN; // read the disk
-    buf0.reserved = 0;
-    buf0.sector = sector;
-
-    // buf0 is on a kernel stack, which is not direct mapped,
-    // thus the call to kvmpa().
-    disk.desc[idx[0]].addr = (uint64)kvmpa((uint64)&buf0);
-    disk.desc[idx[0]].len = sizeof(buf0);
-    disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-    disk.desc[idx[0]].next = idx[1];
-
-    disk.desc[idx[1]].addr = (uint64)b->data;
-    disk.desc[idx[1]].len = BSIZE;
-    if (write)
-        disk.desc[idx[1]].flags = 0; // device reads b->data
-    else
-        disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-    disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-    disk.desc[idx[1]].next = idx[2];
-
-    disk.info[idx[0]].status = 0;
-    disk.desc[idx[2]].addr = (uint64)&disk.info[idx[0]].status;
-    disk.desc[idx[2]].len = 1;
-    disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-    disk.desc[idx[2]].next = 0;
-
-    // record struct buf for virtio_disk_intr().
-    b->disk = 1;
-    disk.info[idx[0]].b = b;
-
-    // avail[0] is flags
-    // avail[1] tells the device how far to look in avail[2...].
-    // avail[2...] are desc[] indices the device should process.
-    // we only tell device the first index in our chain of descriptors.
-    disk.avail[2 + (disk.avail[1] % NUM)] = idx[0];
-    __sync_synchronize();
-    disk.avail[1] = disk.avail[1] + 1;
-
-    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
-
-    // Wait for virtio_disk_intr() to say request has finished.
-    while (b->disk == 1)
+        int k = 0;
+        for (int i = 0; i < n; i++)
+            if (pb[i].disk == d)
+                which[k++] = i;
+        if (k > 0)
+        {
+            if (!disks[d].present)
+                panic("virtio_disk_rwb: no such disk");
+            submit(d, b, pb, which, k, write, buf0, head);
+        }
+    }
+
+    // Wait for virtio_disk_intr() to say each request has finished.
+    for (int i = 0; i < n; i++)
     {
-        sleep(b, &disk.vdisk_lock);
+        struct disk *disk = &disks[pb[i].disk];
+
+        acquire(&disk->vdisk_lock);
+        while (!disk->info[head[i]].done)
+        {
+            sleep(b[i], &disk->vdisk_lock);
+        }
+        if (disk->info[head[i]].status != 0)
+            failed |= 1 << i;
+        disk->info[head[i]].b = 0;
+        free_chain(disk, head[i]);
+        release(&disk->vdisk_lock);
     }
+    for (int i = 0; i < n; i++)
+        b[i]->disk = 0;
 
-    disk.info[idx[0]].b = 0;
-    free_chain(idx[0]);
+    return failed;
+}
 
-    release(&disk.vdisk_lock);
+// Transfer b->data to or from each of the n blocks in pb[], as
+// virtio_disk_rwb, so the copies of a mirrored write proceed in
+// parallel.
+int virtio_disk_rwv(struct buf *b, struct pblock *pb, int n, int write)
+{
+    struct buf *bs[MAXRWV];
+
+    if (n < 1 || n > MAXRWV)
+        panic("virtio_disk_rwv");
+    for (int i = 0; i < n; i++)
+        bs[i] = b;
+    return virtio_disk_rwb(bs, pb, n, write);
 }
 
-void virtio_disk_intr()
+// Read or write b->blockno of disk 0.
+// Returns 0 on success, -1 if the device reported an error.
+int virtio_disk_rw(struct buf *b, int write)
 {
-    acquire(&disk.vdisk_lock);
+    struct pblock pb = {0, b->blockno};
 
-    while ((disk.used_idx % NUM) != (disk.used->id % NUM))
-    {
-        int id = disk.used->elems[disk.used_idx].id;
+    return virtio_disk_rwv(b, &pb, 1, write) ? -1 : 0;
+}
+
+void virtio_disk_intr(int d)
+{
+    struct disk *disk = &disks[d];
 
-        if (disk.info[id].status != 0)
-            panic("virtio_disk_intr status");
+    acquire(&disk->vdisk_lock);
+
+    while ((disk->used_idx % NUM) != (disk->used->id % NUM))
+    {
+        int id = disk->used->elems[disk->used_idx].id;
 
-        disk.info[id].b->disk = 0; // disk is done with buf
-        wakeup(disk.info[id].b);
+        // a failed request is reported by virtio_disk_rwv.
+        disk->info[id].done = 1;
+        wakeup(disk->info[id].b);
 
-        disk.used_idx = (disk.used_idx + 1) % NUM;
+        disk->used_idx = (disk->used_idx + 1) % NUM;
     }
-    *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+    *R(d, VIRTIO_MMIO_INTERRUPT_ACK) =
+        *R(d, VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
-    release(&disk.vdisk_lock);
+    release(&disk->vdisk_lock);
 }
@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -26,8 +28,8 @@ void kvminit()
     // uart registers
     kvmmap(UART0, UART0, PGSIZE, PTE_R | PTE_W);
 
-    // virtio mmio disk interface
-    kvmmap(VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
+    // virtio mmio disk interfaces
+    kvmmap(VIRTIO0, VIRTIO0, NDISK * PGSIZE, PTE_R | PTE_W);
 
     // CLINT
     kvmmap(CLINT, CLINT, 0x10000, PTE_R | PTE_W);
@@ -55,28 +57,20 @@ void kvminithart()
     sfence_vma();
 }
 
-// Return the address of the PTE in page table pagetable
-// that corresponds to virtual address va.  If alloc!=0,
-// create any required page-table pages.
-//
-// The risc-v Sv39 scheme has three levels of page-table
-// pages. A page-table page contains 512 64-bit PTEs.
-// A 64-bit virtual address is split into five fields:
-//   39..63 -- must be zero.
-//   30..38 -- 9 bits of level-2 index.
-//   21..29 -- 9 bits of level-1 index.
-//   12..20 -- 9 bits of level-0 index.
-//    0..11 -- 12 bits of byte offset within the page.
-pte_t *walk(pagetable_t pagetable, uint64 va, int alloc)
+// Like walk, but return the PTE at level leaf, the one that
+// maps a megapage when leaf is 1.
+static pte_t *walklevel(pagetable_t pagetable, uint64 va, int leaf, int alloc)
 {
     if (va >= MAXVA)
         panic("walk");
 
-    for (int level = 2; level > 0; level--)
+    for (int level = 2; level > leaf; level--)
     {
         pte_t *pte = &pagetable[PX(level, va)];
         if (*pte & PTE_V)
         {
+            if (*pte & (PTE_R | PTE_W | PTE_X))
+                return pte; // a leaf already maps va.
             pagetable = (pagetable_t)PTE2PA(*pte);
         }
         else
@@ -87,7 +81,25 @@ pte_t *walk(pagetable_t pagetable, uint64 va, int alloc)
             *pte = PA2PTE(pagetable) | PTE_V;
         }
     }
-    return &pagetable[PX(0, va)];
+    return &pagetable[PX(leaf, va)];
+}
+
+// Return the address of the PTE in page table pagetable
+// that corresponds to virtual address va.  If alloc!=0,
+// create any required page-table pages.
+//
+// The risc-v Sv39 scheme has three levels of page-table
+// pages. A page-table page contains 512 64-bit PTEs.
+// A 64-bit virtual address is split into five fields:
+//   39..63 -- must be zero.
+//   30..38 -- 9 bits of level-2 index.
+//   21..29 -- 9 bits of level-1 index.
+//   12..20 -- 9 bits of level-0 index.
+//    0..11 -- 12 bits of byte offset within the page.
+// If a megapage maps va, return its level-1 PTE instead.
+pte_t *walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+    return walklevel(pagetable, va, 0, alloc);
 }
 
 // Look up a virtual address, return the physical address,
@@ -131,10 +143,12 @@ uint64 kvmpa(uint64 va)
     pte_t *pte;
     uint64 pa;
 
-    pte = walk(kernel_pagetable, va, 0);
-    if (pte == 0)
+    pte = walklevel(kernel_pagetable, va, 1, 0);
+    if (pte == 0 || (*pte & PTE_V) == 0)
         panic("kvmpa");
-    if ((*pte & PTE_V) == 0)
+    if (*pte & (PTE_R | PTE_W | PTE_X))
+        off = va % MEGAPGSIZE; // a megapage maps va
+    else if ((pte = walk(kernel_pagetable, va, 0)) == 0 || (*pte & PTE_V) == 0)
         panic("kvmpa");
     pa = PTE2PA(*pte);
     return pa + off;
@@ -142,32 +156,45 @@ uint64 kvmpa(uint64 va)
 
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
-// be page-aligned. Returns 0 on success, -1 if walk() couldn't
+// be page-aligned. Kernel mappings use a megapage wherever va
+// and pa are both megapage-aligned and at least a megapage is
+// left; user memory is always in pages, which the uvm code
+// assumes. Returns 0 on success, -1 if walk() couldn't
 // allocate a needed page-table page.
 int mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
-    uint64 a, last;
+    uint64 a, last, sz;
     pte_t *pte;
+    int level;
 
     a = PGROUNDDOWN(va);
     last = PGROUNDDOWN(va + size - 1);
     for (;;)
     {
-        if ((pte = walk(pagetable, a, 1)) == 0)
+        sz = PGSIZE;
+        level = 0;
+        if ((perm & PTE_U) == 0 && a % MEGAPGSIZE == 0 &&
+            pa % MEGAPGSIZE == 0 && last - a >= MEGAPGSIZE - PGSIZE)
+        {
+            sz = MEGAPGSIZE;
+            level = 1;
+        }
+        if ((pte = walklevel(pagetable, a, level, 1)) == 0)
             return -1;
         if (*pte & PTE_V)
             panic("remap");
         *pte = PA2PTE(pa) | perm | PTE_V;
-        if (a == last)
+        if (a + sz - PGSIZE == last)
             break;
-        a += PGSIZE;
-        pa += PGSIZE;
+        a += sz;
+        pa += sz;
     }
     return 0;
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Heap pages that were never touched, and so
+// never mapped, are skipped.
 // Optionally free the physical memory.
 void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
@@ -179,10 +206,8 @@ void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 
     for (a = va; a < va + npages * PGSIZE; a += PGSIZE)
     {
-        if ((pte = walk(pagetable, a, 0)) == 0)
-            panic("uvmunmap: walk");
-        if ((*pte & PTE_V) == 0)
-            panic("uvmunmap: not mapped");
+        if ((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+            continue;
         if (PTE_FLAGS(*pte) == PTE_V)
             panic("uvmunmap: not a leaf");
         if (do_free)
@@ -302,35 +327,30 @@ void uvmfree(pagetable_t pagetable, uint64 sz)
     freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
+// Given a parent process's page table, map
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Pages are shared, not copied: writable ones
+// become read-only and PTE_COW in both, and
+// uvmcow copies one when either side writes it.
 // returns 0 on success, -1 on failure.
-// frees any allocated pages on failure.
+// drops any references taken on failure.
 int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
     pte_t *pte;
     uint64 pa, i;
     uint flags;
-    char *mem;
 
     for (i = 0; i < sz; i += PGSIZE)
     {
-        if ((pte = walk(old, i, 0)) == 0)
-            panic("uvmcopy: pte should exist");
-        if ((*pte & PTE_V) == 0)
-            panic("uvmcopy: page not present");
+        if ((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0)
+            continue; // not touched yet; the child maps its own.
+        if (*pte & PTE_W)
+            *pte = (*pte & ~PTE_W) | PTE_COW;
         pa = PTE2PA(*pte);
         flags = PTE_FLAGS(*pte);
-        if ((mem = kalloc()) == 0)
+        if (mappages(new, i, PGSIZE, pa, flags) != 0)
             goto err;
-        memmove(mem, (char *)pa, PGSIZE);
-        if (mappages(new, i, PGSIZE, (uint64)mem, flags) != 0)
-        {
-            kfree(mem);
-            goto err;
-        }
+        kref((void *)pa);
     }
     return 0;
 
@@ -339,6 +359,111 @@ err:
     return -1;
 }
 
+// Make the copy-on-write page at va writable, copying it
+// unless no one else shares it any more.
+// Returns -1 if va is not such a page, or memory is short.
+int uvmcow(pagetable_t pagetable, uint64 va)
+{
+    pte_t *pte;
+    uint64 pa;
+    char *mem;
+
+    if (va >= MAXVA)
+        return -1;
+    pte = walk(pagetable, va, 0);
+    if (pte == 0 || (*pte & (PTE_V | PTE_U | PTE_COW)) !=
+                        (PTE_V | PTE_U | PTE_COW))
+        return -1;
+    pa = PTE2PA(*pte);
+    if (krefcnt((void *)pa) > 1)
+    {
+        if ((mem = kalloc()) == 0)
+            return -1;
+        memmove(mem, (char *)pa, PGSIZE);
+        *pte = PA2PTE(mem) | PTE_FLAGS(*pte);
+        kfree((void *)pa);
+    }
+    *pte = (*pte & ~PTE_COW) | PTE_W;
+    return 0;
+}
+
+// sbrk grows the heap without mapping it. Map the page at va, which
+// must be below sz and not mapped yet, on its first touch, along with
+// the rest of its aligned group of FAULTAROUND pages that is.
+// Returns -1 if va is not such a page, or memory is short.
+int uvmlazy(pagetable_t pagetable, uint64 sz, uint64 va)
+{
+    uint64 a, start;
+    pte_t *pte;
+    char *mem;
+
+    if (va >= sz || va >= MAXVA)
+        return -1;
+    va = PGROUNDDOWN(va);
+    if ((pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_V))
+        return -1;
+
+    start = va - va % (FAULTAROUND * PGSIZE);
+    for (a = start; a < start + FAULTAROUND * PGSIZE && a < sz; a += PGSIZE)
+    {
+        if ((pte = walk(pagetable, a, 0)) != 0 && (*pte & PTE_V))
+            continue;
+        if ((mem = kalloc()) == 0)
+            break;
+        memset(mem, 0, PGSIZE);
+        if (mappages(pagetable, a, PGSIZE, (uint64)mem,
+                     PTE_W | PTE_X | PTE_R | PTE_U) != 0)
+        {
+            kfree(mem);
+            break;
+        }
+    }
+    // the neighbours are only a guess; va itself must be there.
+    return walkaddr(pagetable, va) ? 0 : -1;
+}
+
+// Physical address of user page va for the copy functions below,
+// mapping it first if it is a heap or mapped file page that the current
+// process has not touched yet, and giving it its own copy if it is copy-on-write
+// and write is set. 0 if there is no such page.
+//
+// The copies move through consecutive pages. *last is the PTE of the
+// page before va, or 0 at the start, so while va stays within one
+// page-table page its PTE is just the next entry, without a walk.
+static uint64 useraddr(pagetable_t pagetable, uint64 va, pte_t **last,
+                       int write)
+{
+    struct proc *p = myproc();
+    pte_t *pte;
+
+    if (va >= MAXVA)
+        return 0;
+    if (*last != 0 && va % MEGAPGSIZE != 0)
+        pte = *last + 1;
+    else
+        pte = walk(pagetable, va, 0);
+
+    if (pte == 0 || (*pte & PTE_V) == 0)
+    {
+        if (p == 0 || p->pagetable != pagetable ||
+            (uvmlazy(pagetable, p->sz, va) < 0 &&
+             vma_fault(va, write, 0) < 0))
+            return 0;
+        pte = walk(pagetable, va, 0);
+    }
+    *last = pte;
+    if ((*pte & PTE_U) == 0)
+        return 0;
+    if (write && (*pte & PTE_COW) && uvmcow(pagetable, va) < 0)
+        return 0;
+    // the first store to a page of a mapped file marks it dirty, and
+    // one the mapping does not allow stores to refuses.
+    if (write && (*pte & PTE_W) == 0 && p != 0 && p->pagetable == pagetable &&
+        vma_overlap(p, va, va + 1) && vma_fault(va, 1, 0) < 0)
+        return 0;
+    return PTE2PA(*pte);
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void uvmclear(pagetable_t pagetable, uint64 va)
@@ -357,11 +482,12 @@ void uvmclear(pagetable_t pagetable, uint64 va)
 int copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
     uint64 n, va0, pa0;
+    pte_t *last = 0;
 
     while (len > 0)
     {
         va0 = PGROUNDDOWN(dstva);
-        pa0 = walkaddr(pagetable, va0);
+        pa0 = useraddr(pagetable, va0, &last, 1);
         if (pa0 == 0)
             return -1;
         n = PGSIZE - (dstva - va0);
@@ -382,11 +508,12 @@ int copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 int copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
     uint64 n, va0, pa0;
+    pte_t *last = 0;
 
     while (len > 0)
     {
         va0 = PGROUNDDOWN(srcva);
-        pa0 = walkaddr(pagetable, va0);
+        pa0 = useraddr(pagetable, va0, &last, 0);
         if (pa0 == 0)
             return -1;
         n = PGSIZE - (srcva - va0);
@@ -401,19 +528,23 @@ int copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
     return 0;
 }
 
+// Is any byte of the 64-bit word w zero?
+#define HASZERO(w) (((w)-0x0101010101010101UL) & ~(w) & 0x8080808080808080UL)
+
 // Copy a null-terminated string from user to kernel.
 // Copy bytes to dst from virtual address srcva in a given page table,
 // until a '\0', or max.
 // Return 0 on success, -1 on error.
 int copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
-    uint64 n, va0, pa0;
+    uint64 n, va0, pa0, w;
+    pte_t *last = 0;
     int got_null = 0;
 
     while (got_null == 0 && max > 0)
     {
         va0 = PGROUNDDOWN(srcva);
-        pa0 = walkaddr(pagetable, va0);
+        pa0 = useraddr(pagetable, va0, &last, 0);
         if (pa0 == 0)
             return -1;
         n = PGSIZE - (srcva - va0);
@@ -423,6 +554,21 @@ int copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
         char *p = (char *)(pa0 + (srcva - va0));
         while (n > 0)
         {
+            // a word at a time, while p is aligned and
+            // none of the word's bytes is the NUL.
+            if (n >= 8 && (uint64)p % 8 == 0)
+            {
+                w = *(uint64 *)p;
+                if (!HASZERO(w))
+                {
+                    memmove(dst, &w, 8);
+                    n -= 8;
+                    max -= 8;
+                    p += 8;
+                    dst += 8;
+                    continue;
+                }
+            }
             if (*p == '\0')
             {
                 *dst = '\0';
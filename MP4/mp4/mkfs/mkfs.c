@@ -10,6 +10,9 @@
 #include "kernel/fs.h"
 #include "kernel/stat.h"
 #include "kernel/param.h"
+#include "kernel/bdev.h"
+#include "kernel/raid.h"
+#include "kernel/csum.h"
 
 #ifndef static_assert
 #define static_assert(a, b)                                                    \
@@ -23,17 +26,22 @@
 
 #define NINODES 200
 
-int nbitmap = LOGICAL_DISK_SIZE / (BSIZE * 8) + 1;
+int nbitmap;
+int ncsum;
 int ninodeblocks = NINODES / IPB + 1;
 int nlog = LOGSIZE;
 int nmeta;
 int nblocks;
+int fssize; // logical blocks
 
-int fsfd;
+int fsfd[NDISK]; // one image per disk, each FSSIZE blocks
 struct superblock sb;
-char zeroes[BSIZE];
+struct superblock geo; // sb's layout fields, in host order
 uint freeinode = 1;
 uint freeblock;
+uint nbuckets; // non-zero: the root directory is hashed, see fs.h
+uint *csums;   // checksum of every block, see csum.h
+uint crc32c_table[4][256];
 
 void balloc(int);
 void wsect(uint, void *);
@@ -42,6 +50,8 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void dirappend(uint dinum, struct dirent *de);
+void wcsums(void);
 
 ushort xshort(ushort x)
 {
@@ -63,52 +73,164 @@ uint xint(uint x)
     return y;
 }
 
+void usage(void)
+{
+    fprintf(stderr, "Usage: mkfs fs.img [-H nbuckets] [-L raid1|raid0|raid10] "
+                    "[-d ndisk] [-m nmember] [-c chunk] files...\n");
+    exit(1);
+}
+
+// Check the layout options and work out the size of each member and
+// of the file system. Each disk holds nmember/ndisk members.
+void setlayout(void)
+{
+    uint perdisk;
+
+    if (geo.ndisk < 1 || geo.ndisk > NDISK)
+    {
+        fprintf(stderr, "mkfs: ndisk must be 1..%d\n", NDISK);
+        exit(1);
+    }
+    if (geo.nmember == 0)
+    {
+        if (geo.layout == LAYOUT_RAID10)
+            geo.nmember = 4;
+        else
+            geo.nmember = geo.ndisk < 2 ? 2 : geo.ndisk;
+    }
+    if (geo.nmember > NMEMBER || geo.nmember % geo.ndisk ||
+        (geo.layout != LAYOUT_RAID0 && geo.nmember < 2) ||
+        (geo.layout == LAYOUT_RAID10 && geo.nmember % 2))
+    {
+        fprintf(stderr, "mkfs: bad member count %d for %d disks\n",
+                geo.nmember, geo.ndisk);
+        exit(1);
+    }
+    perdisk = geo.nmember / geo.ndisk;
+    if (geo.chunk == 0)
+        geo.chunk = 16;
+
+    geo.msize = FSSIZE / perdisk;
+    if (geo.layout == LAYOUT_RAID0)
+        fssize = geo.msize / geo.chunk * geo.chunk * geo.nmember;
+    else if (geo.layout == LAYOUT_RAID10)
+        fssize = geo.msize / geo.chunk * geo.chunk * (geo.nmember / 2);
+    else
+        fssize = geo.msize;
+}
+
+void openimage(int d, char *name)
+{
+    fsfd[d] = open(name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fsfd[d] < 0)
+    {
+        perror(name);
+        exit(1);
+    }
+    if (ftruncate(fsfd[d], FSSIZE * BSIZE) < 0)
+    {
+        perror("ftruncate");
+        exit(1);
+    }
+}
+
 int main(int argc, char *argv[])
 {
-    int i, cc, fd;
+    int i, first, cc, fd;
     uint rootino, inum, off;
     struct dirent de;
-    char buf[BSIZE];
+    char buf[BSIZE], name[256];
     struct dinode din;
 
     static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
     if (argc < 2)
+        usage();
+
+    geo.layout = LAYOUT_RAID1;
+    geo.ndisk = 1;
+    for (first = 2; first + 1 < argc && argv[first][0] == '-'; first += 2)
     {
-        fprintf(stderr, "Usage: mkfs fs.img files...\n");
-        exit(1);
+        char *opt = argv[first], *val = argv[first + 1];
+
+        if (strcmp(opt, "-H") == 0)
+        {
+            nbuckets = atoi(val);
+            if (nbuckets < 1 || nbuckets > MAXDIRBUCKET)
+            {
+                fprintf(stderr, "mkfs: nbuckets must be 1..%d\n",
+                        MAXDIRBUCKET);
+                exit(1);
+            }
+        }
+        else if (strcmp(opt, "-L") == 0)
+        {
+            if (strcmp(val, "raid1") == 0)
+                geo.layout = LAYOUT_RAID1;
+            else if (strcmp(val, "raid0") == 0)
+                geo.layout = LAYOUT_RAID0;
+            else if (strcmp(val, "raid10") == 0)
+                geo.layout = LAYOUT_RAID10;
+            else
+                usage();
+        }
+        else if (strcmp(opt, "-d") == 0)
+            geo.ndisk = atoi(val);
+        else if (strcmp(opt, "-m") == 0)
+            geo.nmember = atoi(val);
+        else if (strcmp(opt, "-c") == 0)
+            geo.chunk = atoi(val);
+        else
+            usage();
     }
+    setlayout();
 
     assert((BSIZE % sizeof(struct dinode)) == 0);
     assert((BSIZE % sizeof(struct dirent)) == 0);
 
-    fsfd = open(argv[1], O_RDWR | O_CREAT | O_TRUNC, 0666);
-    if (fsfd < 0)
+    openimage(0, argv[1]);
+    for (i = 1; i < geo.ndisk; i++)
     {
-        perror(argv[1]);
-        exit(1);
+        snprintf(name, sizeof(name), "%s.%d", argv[1], i);
+        openimage(i, name);
     }
 
-    nmeta = 2 + nlog + ninodeblocks + nbitmap;
-    nblocks = LOGICAL_DISK_SIZE - nmeta;
+    nbitmap = fssize / (BSIZE * 8) + 1;
+    ncsum = NCSUMBLK(fssize);
+    nmeta = 2 + nlog + ninodeblocks + nbitmap + RAIDMAPBLKS + ncsum;
+    nblocks = fssize - nmeta;
 
     sb.magic = FSMAGIC;
-    sb.size = xint(LOGICAL_DISK_SIZE);
+    sb.size = xint(fssize);
     sb.nblocks = xint(nblocks);
     sb.ninodes = xint(NINODES);
     sb.nlog = xint(nlog);
     sb.logstart = xint(2);
     sb.inodestart = xint(2 + nlog);
     sb.bmapstart = xint(2 + nlog + ninodeblocks);
+    sb.raidmap = xint(2 + nlog + ninodeblocks + nbitmap);
+    sb.csumstart = xint(2 + nlog + ninodeblocks + nbitmap + RAIDMAPBLKS);
+    sb.layout = xint(geo.layout);
+    sb.ndisk = xint(geo.ndisk);
+    sb.nmember = xint(geo.nmember);
+    sb.msize = xint(geo.msize);
+    sb.chunk = xint(geo.chunk);
 
     printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap "
-           "blocks %u) blocks %d total %d\n",
-           nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+           "blocks %u, raid map %u, checksum blocks %u) blocks %d total %d\n",
+           nmeta, nlog, ninodeblocks, nbitmap, RAIDMAPBLKS, ncsum, nblocks,
+           fssize);
+    printf("layout %d: %d members of %d blocks on %d disks, chunk %d\n",
+           geo.layout, geo.nmember, geo.msize, geo.ndisk, geo.chunk);
 
     freeblock = nmeta;
 
-    for (i = 0; i < FSSIZE; i++)
-        wsect(i, zeroes);
+    // every block starts out zero.
+    crc32c_init();
+    memset(buf, 0, sizeof(buf));
+    csums = malloc(ncsum * BSIZE);
+    for (i = 0; i < ncsum * CPB; i++)
+        csums[i] = xint(crc32c((uchar *)buf, BSIZE));
 
     memset(buf, 0, sizeof(buf));
     memmove(buf, &sb, sizeof(sb));
@@ -116,18 +238,25 @@ int main(int argc, char *argv[])
 
     rootino = ialloc(T_DIR);
     assert(rootino == ROOTINO);
+    if (nbuckets)
+    {
+        rinode(rootino, &din);
+        din.major = xshort(nbuckets);
+        din.size = xint(nbuckets * BSIZE);
+        winode(rootino, &din);
+    }
 
     bzero(&de, sizeof(de));
     de.inum = xshort(rootino);
     strcpy(de.name, ".");
-    iappend(rootino, &de, sizeof(de));
+    dirappend(rootino, &de);
 
     bzero(&de, sizeof(de));
     de.inum = xshort(rootino);
     strcpy(de.name, "..");
-    iappend(rootino, &de, sizeof(de));
+    dirappend(rootino, &de);
 
-    for (i = 2; i < argc; i++)
+    for (i = first; i < argc; i++)
     {
         char *shortname;
 
@@ -152,7 +281,7 @@ int main(int argc, char *argv[])
         bzero(&de, sizeof(de));
         de.inum = xshort(inum);
         strncpy(de.name, shortname, DIRSIZ);
-        iappend(rootino, &de, sizeof(de));
+        dirappend(rootino, &de);
 
         while ((cc = read(fd, buf, sizeof(buf))) > 0)
             iappend(inum, buf, cc);
@@ -160,31 +289,54 @@ int main(int argc, char *argv[])
         close(fd);
     }
 
-    rinode(rootino, &din);
-    off = xint(din.size);
-    off = ((off / BSIZE) + 1) * BSIZE;
-    din.size = xint(off);
-    winode(rootino, &din);
+    if (!nbuckets)
+    {
+        rinode(rootino, &din);
+        off = xint(din.size);
+        off = ((off / BSIZE) + 1) * BSIZE;
+        din.size = xint(off);
+        winode(rootino, &din);
+    }
 
     balloc(freeblock);
+    wcsums();
 
     exit(0);
 }
 
+// Write every copy of logical block sec, so that the kernel can read
+// any one, and note its checksum.
 void wsect(uint sec, void *buf)
 {
-    if (lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE)
-    {
-        perror("lseek");
-        exit(1);
-    }
-    if (write(fsfd, buf, BSIZE) != BSIZE)
+    struct pblock pb[NMEMBER];
+    int n;
+
+    if (sec < xint(sb.csumstart) || sec >= xint(sb.csumstart) + ncsum)
+        csums[sec] = xint(crc32c(buf, BSIZE));
+    n = bmapcopies(&geo, sec, pb, 0);
+    for (int i = 0; i < n; i++)
     {
-        perror("write");
-        exit(1);
+        if (lseek(fsfd[pb[i].disk], pb[i].blockno * BSIZE, 0) !=
+            pb[i].blockno * BSIZE)
+        {
+            perror("lseek");
+            exit(1);
+        }
+        if (write(fsfd[pb[i].disk], buf, BSIZE) != BSIZE)
+        {
+            perror("write");
+            exit(1);
+        }
     }
 }
 
+// Write the checksum table, once every other block is written.
+void wcsums(void)
+{
+    for (int i = 0; i < ncsum; i++)
+        wsect(xint(sb.csumstart) + i, (char *)csums + i * BSIZE);
+}
+
 void winode(uint inum, struct dinode *ip)
 {
     char buf[BSIZE];
@@ -212,12 +364,16 @@ void rinode(uint inum, struct dinode *ip)
 
 void rsect(uint sec, void *buf)
 {
-    if (lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE)
+    struct pblock pb[NMEMBER];
+
+    bmapcopies(&geo, sec, pb, 0);
+    if (lseek(fsfd[pb[0].disk], pb[0].blockno * BSIZE, 0) !=
+        pb[0].blockno * BSIZE)
     {
         perror("lseek");
         exit(1);
     }
-    if (read(fsfd, buf, BSIZE) != BSIZE)
+    if (read(fsfd[pb[0].disk], buf, BSIZE) != BSIZE)
     {
         perror("read");
         exit(1);
@@ -257,13 +413,40 @@ void balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the sector holding block fbn of din, allocating it if needed.
+uint ibmap(struct dinode *din, uint fbn)
+{
+    uint indirect[NINDIRECT];
+
+    assert(fbn < MAXFILE);
+    if (fbn < NDIRECT)
+    {
+        if (xint(din->addrs[fbn]) == 0)
+        {
+            din->addrs[fbn] = xint(freeblock++);
+        }
+        return xint(din->addrs[fbn]);
+    }
+
+    if (xint(din->addrs[NDIRECT]) == 0)
+    {
+        din->addrs[NDIRECT] = xint(freeblock++);
+    }
+    rsect(xint(din->addrs[NDIRECT]), (char *)indirect);
+    if (indirect[fbn - NDIRECT] == 0)
+    {
+        indirect[fbn - NDIRECT] = xint(freeblock++);
+        wsect(xint(din->addrs[NDIRECT]), (char *)indirect);
+    }
+    return xint(indirect[fbn - NDIRECT]);
+}
+
 void iappend(uint inum, void *xp, int n)
 {
     char *p = (char *)xp;
     uint fbn, off, n1;
     struct dinode din;
     char buf[BSIZE];
-    uint indirect[NINDIRECT];
     uint x;
 
     rinode(inum, &din);
@@ -272,29 +455,7 @@ void iappend(uint inum, void *xp, int n)
     while (n > 0)
     {
         fbn = off / BSIZE;
-        assert(fbn < MAXFILE);
-        if (fbn < NDIRECT)
-        {
-            if (xint(din.addrs[fbn]) == 0)
-            {
-                din.addrs[fbn] = xint(freeblock++);
-            }
-            x = xint(din.addrs[fbn]);
-        }
-        else
-        {
-            if (xint(din.addrs[NDIRECT]) == 0)
-            {
-                din.addrs[NDIRECT] = xint(freeblock++);
-            }
-            rsect(xint(din.addrs[NDIRECT]), (char *)indirect);
-            if (indirect[fbn - NDIRECT] == 0)
-            {
-                indirect[fbn - NDIRECT] = xint(freeblock++);
-                wsect(xint(din.addrs[NDIRECT]), (char *)indirect);
-            }
-            x = xint(indirect[fbn - NDIRECT]);
-        }
+        x = ibmap(&din, fbn);
         n1 = min(n, (fbn + 1) * BSIZE - off);
         rsect(x, buf);
         bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -306,3 +467,55 @@ void iappend(uint inum, void *xp, int n)
     din.size = xint(off);
     winode(inum, &din);
 }
+
+// Add de to directory dinum, placing it the way the kernel's
+// dirlink does when the directory is hashed.
+void dirappend(uint dinum, struct dirent *de)
+{
+    struct dinode din;
+    struct dirent ents[DPB];
+    struct dirhdr *hdr = (struct dirhdr *)ents;
+    uint h, b, i, slot, x;
+    int dots;
+
+    if (!nbuckets)
+    {
+        iappend(dinum, de, sizeof(*de));
+        return;
+    }
+
+    dots = strcmp(de->name, ".") == 0 || strcmp(de->name, "..") == 0;
+    h = dots ? 0 : dirhash(de->name) % nbuckets;
+    rinode(dinum, &din);
+    for (i = 0; i < nbuckets; i++)
+    {
+        b = (h + i) % nbuckets;
+        x = ibmap(&din, b);
+        rsect(x, (char *)ents);
+        for (slot = 1; slot < DPB; slot++)
+            if (ents[slot].inum == 0)
+                break;
+        if (slot < DPB)
+            break;
+    }
+    assert(i < nbuckets);
+    ents[slot] = *de;
+    wsect(x, (char *)ents);
+    winode(dinum, &din);
+
+    x = ibmap(&din, h);
+    rsect(x, (char *)ents);
+    if (i > xshort(hdr->probe))
+    {
+        hdr->probe = xshort(i);
+        wsect(x, (char *)ents);
+    }
+    if (!dots)
+    {
+        x = ibmap(&din, 0);
+        rsect(x, (char *)ents);
+        hdr->nentries = xint(xint(hdr->nentries) + 1);
+        wsect(x, (char *)ents);
+    }
+    winode(dinum, &din);
+}
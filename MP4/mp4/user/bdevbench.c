@@ -0,0 +1,52 @@
+// Measure write and read throughput of the block device layout the
+// image was made with (see DISKS and MKFSFLAGS in the Makefile). The
+// file is larger than the buffer cache, so both passes reach the disks.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+
+#define FILE "bdevbench.dat"
+#define NBLOCK 400
+
+char buf[BSIZE];
+
+int main(int argc, char *argv[])
+{
+    int fd, t0, tw, tr;
+
+    t0 = uptime();
+    if ((fd = open(FILE, O_CREATE | O_WRONLY)) < 0)
+    {
+        fprintf(2, "bdevbench: cannot create %s\n", FILE);
+        exit(1);
+    }
+    memset(buf, 'b', sizeof(buf));
+    for (int i = 0; i < NBLOCK; i++)
+    {
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+        {
+            fprintf(2, "bdevbench: write failed\n");
+            exit(1);
+        }
+    }
+    close(fd);
+    tw = uptime() - t0;
+
+    t0 = uptime();
+    if ((fd = open(FILE, O_RDONLY)) < 0)
+    {
+        fprintf(2, "bdevbench: cannot open %s\n", FILE);
+        exit(1);
+    }
+    while (read(fd, buf, sizeof(buf)) == sizeof(buf))
+        ;
+    close(fd);
+    tr = uptime() - t0;
+
+    printf("%d KB: write %d ticks, read %d ticks\n", NBLOCK, tw, tr);
+    unlink(FILE);
+    exit(0);
+}
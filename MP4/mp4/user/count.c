@@ -2,6 +2,7 @@
 
 #include "kernel/fs.h"
 #include "kernel/stat.h"
+#include "kernel/fcntl.h"
 #include "user/user.h"
 
 #define MAX_DEPTH 20
@@ -29,111 +30,122 @@ void print(char *basename, int level, int is_last[])
         printf("+-- %s\n", basename);
     }
 }
-void traverse(char *path, char *basename, int level, int is_last[],
-              int *file_num, int *dir_num)
+// Read the next entry of directory fd other than "." and "..".
+int nextent(int fd, struct dirent *de)
 {
-    char buf[512], *p;
-    int fd;
-    struct dirent de;
-    struct stat st;
-
-    if ((fd = open(path, 0)) < 0)
+    while (read(fd, de, sizeof(*de)) == sizeof(*de))
     {
-        printf("%s [error opening dir]\n", path);
-        return;
+        if (de->inum == 0)
+            continue;
+        if (strcmp(de->name, ".") && strcmp(de->name, ".."))
+            return 1;
     }
+    return 0;
+}
 
-    if (fstat(fd, &st) < 0)
+void walk(int fd, char *path, int level, int is_last[], int *file_num,
+          int *dir_num);
+
+// Visit entry name of the directory open as dirfd. Lookups go through
+// fstatat/openat so each entry costs one dirlookup in its parent
+// instead of a walk of the full path; path is only used for messages.
+void visit(int dirfd, char *path, char *name, int level, int is_last[],
+           int *file_num, int *dir_num)
+{
+    struct stat st;
+    int fd;
+
+    if (fstatat(dirfd, name, &st) < 0 || !(st.mode & M_READ))
     {
-        fprintf(2, "tree: cannot stat (new recursion) %s\n", path);
+        printf("%s [error opening dir]\n", path);
         return;
     }
-    else
-    {
-        close(fd);
-    }
 
     if (st.type == T_FILE)
     {
-        if (level == 0)
-        {
-            printf("%s [error opening dir]\n", path);
-            return;
-        }
         (*file_num)++;
-        print(basename, level, is_last);
+        print(name, level, is_last);
         return;
     }
-    else if (st.type == T_DIR)
+    else if (st.type != T_DIR)
     {
-        if (level > 0)
-        {
-            (*dir_num)++;
-        }
-        print(basename, level, is_last);
+        return;
     }
-    else
+
+    (*dir_num)++;
+    print(name, level, is_last);
+
+    if ((fd = openat(dirfd, name, O_RDONLY)) < 0)
     {
-        // printf("tree: path %s is a device\n", path);
+        printf("%s [error opening dir]\n", path);
         return;
     }
+    walk(fd, path, level, is_last, file_num, dir_num);
+    close(fd);
+}
+
+// Visit every entry of the directory open as fd, whose path is path.
+// Entries are read one ahead so the last one is known without a
+// second pass over the directory.
+void walk(int fd, char *path, int level, int is_last[], int *file_num,
+          int *dir_num)
+{
+    char buf[512], *p;
+    struct dirent de, next;
+    int have;
 
     if (strlen(path) + 1 + DIRSIZ + 1 > sizeof buf)
     {
         printf("tree: path too long\n");
-        close(fd);
         return;
     }
     strcpy(buf, path);
     p = buf + strlen(buf);
     *p++ = '/';
 
-    int count = 0;
-    if ((fd = open(path, 0)) < 0)
-    {
-        printf("%s [error opening dir]\n", path);
-        return;
-    }
-    while (read(fd, &de, sizeof(de)) == sizeof(de))
+    have = nextent(fd, &next);
+    while (have)
     {
-        if (de.inum == 0)
-            continue;
+        de = next;
+        have = nextent(fd, &next);
+
         memmove(p, de.name, DIRSIZ);
         p[DIRSIZ] = 0;
-        if (strcmp(de.name, ".") && strcmp(de.name, ".."))
-        {
-            count++;
-        }
+        is_last[level] = !have;
+        visit(fd, buf, p, level + 1, is_last, file_num, dir_num);
+        is_last[level] = 0;
     }
-    close(fd);
-    if ((fd = open(path, 0)) < 0)
+}
+
+void traverse(char *path, int is_last[], int *file_num, int *dir_num)
+{
+    int fd;
+    struct stat st;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
     {
-        fprintf(2, "tree: cannot open %s after counting files\n", path);
+        printf("%s [error opening dir]\n", path);
         return;
     }
-    // read files under current path
-    int cnt = 0;
-    while (read(fd, &de, sizeof(de)) == sizeof(de))
+
+    if (fstat(fd, &st) < 0)
     {
-        if (de.inum == 0)
-            continue;
+        fprintf(2, "tree: cannot stat %s\n", path);
+        close(fd);
+        return;
+    }
 
-        memmove(p, de.name, DIRSIZ);
-        p[DIRSIZ] = 0;
-        if (strcmp(de.name, ".") && strcmp(de.name, ".."))
-        {
-            if (cnt == count - 1)
-            {
-                is_last[level] = 1;
-            }
-            cnt++;
-            traverse(buf, de.name, level + 1, is_last, file_num, dir_num);
-            is_last[level] = 0;
-        }
+    if (st.type == T_DIR)
+    {
+        print(path, 0, is_last);
+        walk(fd, path, 0, is_last, file_num, dir_num);
+    }
+    else if (st.type == T_FILE)
+    {
+        printf("%s [error opening dir]\n", path);
     }
 
     close(fd);
-    return;
 }
 
 int main(int argc, char *argv[])
@@ -163,7 +175,7 @@ int main(int argc, char *argv[])
     { // Child
         int file_num = 0, dir_num = 0;
         int is_last[MAX_DEPTH] = {};
-        traverse(argv[1], argv[1], 0, is_last, &file_num, &dir_num);
+        traverse(argv[1], is_last, &file_num, &dir_num);
 
         write(fds[1], &file_num, sizeof(int));
         write(fds[1], &dir_num, sizeof(int));
@@ -0,0 +1,88 @@
+// Time name lookups in one large directory.
+// Build fs.img with MKFSFLAGS="-H 64" to compare hashed directories
+// against the default linear ones.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+#define DIR "dirbench.d"
+
+static void mkname(char *buf, int i)
+{
+    char tmp[8];
+    int n = 0;
+
+    strcpy(buf, DIR "/n");
+    buf += strlen(buf);
+    do
+    {
+        tmp[n++] = '0' + i % 10;
+        i /= 10;
+    } while (i > 0);
+    while (n > 0)
+        *buf++ = tmp[--n];
+    *buf = 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, fd, n, t0;
+    char name[32];
+    struct stat st;
+
+    n = argc > 1 ? atoi(argv[1]) : 200;
+
+    if (mkdir(DIR) < 0)
+    {
+        fprintf(2, "dirbench: cannot mkdir %s\n", DIR);
+        exit(1);
+    }
+    if ((fd = open(DIR "/f", O_CREATE | O_RDWR)) < 0)
+    {
+        fprintf(2, "dirbench: cannot create %s/f\n", DIR);
+        exit(1);
+    }
+    close(fd);
+
+    t0 = uptime();
+    for (i = 0; i < n; i++)
+    {
+        mkname(name, i);
+        if (link(DIR "/f", name) < 0)
+        {
+            fprintf(2, "dirbench: link %s failed\n", name);
+            exit(1);
+        }
+    }
+    printf("link %d names: %d ticks\n", n, uptime() - t0);
+
+    t0 = uptime();
+    for (i = 0; i < n; i++)
+    {
+        mkname(name, i);
+        if (stat(name, &st) < 0)
+        {
+            fprintf(2, "dirbench: stat %s failed\n", name);
+            exit(1);
+        }
+    }
+    printf("stat %d names: %d ticks\n", n, uptime() - t0);
+
+    t0 = uptime();
+    for (i = 0; i < n; i++)
+    {
+        mkname(name, i);
+        if (unlink(name) < 0)
+        {
+            fprintf(2, "dirbench: unlink %s failed\n", name);
+            exit(1);
+        }
+    }
+    printf("unlink %d names: %d ticks\n", n, uptime() - t0);
+
+    unlink(DIR "/f");
+    unlink(DIR);
+    exit(0);
+}
@@ -0,0 +1,52 @@
+// Read all of disk 0 with raw_readv, MAXRAWV blocks per call and
+// bypassing the buffer cache, and count the blocks whose RAID-1 copies
+// (PBN and PBN + DISK1_START_BLOCK) differ. For comparison, also time
+// the same sweep done one raw_read at a time.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/fs.h"
+#include "kernel/rawio.h"
+#include "user/user.h"
+
+char buf[2][MAXRAWV][BSIZE];
+
+int main(int argc, char *argv[])
+{
+    struct rawvec v[2][MAXRAWV];
+    int t0, tv, t1, differ = 0;
+
+    t0 = uptime();
+    for (int pbn = 0; pbn < DISK1_START_BLOCK; pbn += MAXRAWV)
+    {
+        for (int c = 0; c < 2; c++)
+        {
+            for (int i = 0; i < MAXRAWV; i++)
+            {
+                v[c][i].disk = 0;
+                v[c][i].pbn = pbn + i + c * DISK1_START_BLOCK;
+                v[c][i].buf = buf[c][i];
+            }
+            if (raw_readv(v[c], MAXRAWV, RAW_NOCACHE) < 0)
+            {
+                fprintf(2, "disksweep: raw_readv failed at %d\n", pbn);
+                exit(1);
+            }
+        }
+        for (int i = 0; i < MAXRAWV; i++)
+            if (memcmp(buf[0][i], buf[1][i], BSIZE) != 0)
+                differ++;
+    }
+    tv = uptime() - t0;
+
+    t0 = uptime();
+    for (int pbn = 0; pbn < FSSIZE; pbn++)
+        raw_read(pbn, buf[0][0]);
+    t1 = uptime() - t0;
+
+    printf("%d blocks: %d ticks with raw_readv, %d with raw_read; "
+           "%d mirrored blocks differ\n",
+           FSSIZE, tv, t1, differ);
+    exit(0);
+}
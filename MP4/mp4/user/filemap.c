@@ -0,0 +1,54 @@
+// Print the disk extents of each file named, from one fiemap() call
+// per NEXT extents.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+#define NEXT 16
+
+struct fextent ext[NEXT];
+
+static void filemap(char *path)
+{
+    int fd, n, start = 0, total = 0, blocks = 0;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        fprintf(2, "filemap: cannot open %s\n", path);
+        return;
+    }
+    printf("%s:\n", path);
+    do
+    {
+        if ((n = fiemap(fd, start, ext, NEXT)) < 0)
+        {
+            fprintf(2, "filemap: fiemap failed on %s\n", path);
+            break;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            printf("  blocks %d-%d at %d\n", ext[i].lbn,
+                   ext[i].lbn + ext[i].len - 1, ext[i].pbn);
+            blocks += ext[i].len;
+        }
+        total += n;
+        if (n > 0)
+            start = ext[n - 1].lbn + ext[n - 1].len;
+    } while (n == NEXT);
+    printf("  %d blocks in %d extents\n", blocks, total);
+    close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(2, "usage: filemap file...\n");
+        exit(1);
+    }
+    for (int i = 1; i < argc; i++)
+        filemap(argv[i]);
+    exit(0);
+}
@@ -0,0 +1,64 @@
+// Measure fork+exec+wait latency for processes of different sizes.
+// With copy-on-write fork it should grow with the page table, not
+// with the memory the parent has touched.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/param.h"
+
+#define NFORK 50
+
+char *argv_echo[] = {"echo", "forkbench", 0};
+
+int sizes[] = {0, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024};
+
+// Run NFORK commands from a process grown by extra bytes, all of them
+// touched, and return the elapsed microseconds.
+static uint64 run(int extra)
+{
+    char *mem = sbrk(extra);
+    uint64 t0;
+    int pid;
+
+    if (mem == (char *)-1)
+    {
+        fprintf(2, "forkbench: sbrk %d failed\n", extra);
+        exit(1);
+    }
+    for (int i = 0; i < extra; i += 4096)
+        mem[i] = 1;
+
+    t0 = uptimeus();
+    for (int i = 0; i < NFORK; i++)
+    {
+        if ((pid = fork()) < 0)
+        {
+            fprintf(2, "forkbench: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0)
+        {
+            close(1);
+            exec(argv_echo[0], argv_echo);
+            exit(1);
+        }
+        wait(0);
+    }
+    t0 = uptimeus() - t0;
+    sbrk(-extra);
+    return t0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64 t;
+
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        t = run(sizes[i]);
+        printf("%d KB: %d us per fork+exec+wait\n", sizes[i] / 1024,
+               (int)(t / NFORK));
+    }
+    exit(0);
+}
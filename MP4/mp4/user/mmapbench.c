@@ -0,0 +1,112 @@
+// Compare summing a file through read() with summing it through mmap,
+// and check that stores to a MAP_SHARED mapping reach the file.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+
+#define FILE "mmapbench.dat"
+#define NBLOCK 64
+#define SIZE (NBLOCK * BSIZE)
+#define NPASS 20
+
+char buf[BSIZE];
+
+static uint readsum(void)
+{
+    uint sum = 0;
+    int fd, n;
+
+    if ((fd = open(FILE, O_RDONLY)) < 0)
+    {
+        fprintf(2, "mmapbench: cannot open %s\n", FILE);
+        exit(1);
+    }
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        for (int i = 0; i < n; i++)
+            sum += (uchar)buf[i];
+    close(fd);
+    return sum;
+}
+
+static uint mapsum(void)
+{
+    uint sum = 0;
+    uchar *p;
+    int fd;
+
+    if ((fd = open(FILE, O_RDONLY)) < 0 ||
+        (p = mmap(0, SIZE, PROT_READ, MAP_PRIVATE, fd, 0)) == (uchar *)-1)
+    {
+        fprintf(2, "mmapbench: cannot map %s\n", FILE);
+        exit(1);
+    }
+    close(fd); // the mapping keeps the file open
+    for (int i = 0; i < SIZE; i++)
+        sum += p[i];
+    munmap(p, SIZE);
+    return sum;
+}
+
+int main(int argc, char *argv[])
+{
+    int fd, t0, t1, t2;
+    uint want = 0, got = 0;
+    char *p;
+
+    if ((fd = open(FILE, O_CREATE | O_WRONLY)) < 0)
+    {
+        fprintf(2, "mmapbench: cannot create %s\n", FILE);
+        exit(1);
+    }
+    for (int i = 0; i < NBLOCK; i++)
+    {
+        memset(buf, 'a' + i % 26, sizeof(buf));
+        write(fd, buf, sizeof(buf));
+    }
+    close(fd);
+
+    // a store through a shared mapping, seen by read() after munmap.
+    fd = open(FILE, O_RDWR);
+    p = mmap(0, SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == (char *)-1)
+    {
+        fprintf(2, "mmapbench: cannot map %s shared\n", FILE);
+        exit(1);
+    }
+    if (p[SIZE - 1] != 'a' + (NBLOCK - 1) % 26)
+    {
+        fprintf(2, "mmapbench: wrong contents\n");
+        exit(1);
+    }
+    p[BSIZE] = 'Z';
+    munmap(p, SIZE);
+    read(fd, buf, sizeof(buf));
+    read(fd, buf, sizeof(buf));
+    close(fd);
+    if (buf[0] != 'Z')
+    {
+        fprintf(2, "mmapbench: store was not written back\n");
+        exit(1);
+    }
+
+    t0 = uptime();
+    for (int i = 0; i < NPASS; i++)
+        want += readsum();
+    t1 = uptime();
+    for (int i = 0; i < NPASS; i++)
+        got += mapsum();
+    t2 = uptime();
+    if (got != want)
+    {
+        fprintf(2, "mmapbench: sums differ\n");
+        exit(1);
+    }
+    printf("read: %d ticks, mmap: %d ticks for %d KB\n", t1 - t0, t2 - t1,
+           NPASS * SIZE / 1024);
+
+    unlink(FILE);
+    exit(0);
+}
@@ -0,0 +1,83 @@
+// Measure context switches per second. Pairs of processes bounce a
+// byte back and forth over two pipes, so each round trip is two
+// switches. Run it with different "make qemu CPUS=n" to compare
+// hart counts.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/param.h"
+
+#define NROUND 2000
+#define MAXPAIR 8
+
+static void pair(void)
+{
+    int ping[2], pong[2];
+    char c = 'p';
+
+    if (pipe(ping) < 0 || pipe(pong) < 0)
+    {
+        fprintf(2, "pingpong: pipe failed\n");
+        exit(1);
+    }
+    if (fork() == 0)
+    {
+        close(ping[1]);
+        close(pong[0]);
+        while (read(ping[0], &c, 1) == 1)
+            write(pong[1], &c, 1);
+        exit(0);
+    }
+    close(ping[0]);
+    close(pong[1]);
+    for (int i = 0; i < NROUND; i++)
+    {
+        if (write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1)
+        {
+            fprintf(2, "pingpong: lost the ball\n");
+            exit(1);
+        }
+    }
+    close(ping[1]);
+    close(pong[0]);
+    wait(0);
+    exit(0);
+}
+
+// Run npair pairs at once and return the elapsed ticks.
+static int run(int npair)
+{
+    int t0 = uptime();
+
+    for (int i = 0; i < npair; i++)
+        if (fork() == 0)
+            pair();
+    for (int i = 0; i < npair; i++)
+        wait(0);
+    return uptime() - t0;
+}
+
+int main(int argc, char *argv[])
+{
+    int maxpair = 4, t, nswitch;
+
+    if (argc > 1)
+        maxpair = atoi(argv[1]);
+    if (maxpair < 1 || maxpair > MAXPAIR)
+    {
+        fprintf(2, "usage: pingpong [pairs, 1-%d]\n", MAXPAIR);
+        exit(1);
+    }
+
+    for (int n = 1; n <= maxpair; n *= 2)
+    {
+        t = run(n);
+        if (t == 0)
+            t = 1;
+        nswitch = 2 * NROUND * n;
+        printf("%d pairs: %d switches in %d ticks, %d switches/sec\n", n,
+               nswitch, t, nswitch * HZ / t);
+    }
+    exit(0);
+}
@@ -0,0 +1,85 @@
+// Print RAID-1 event counters, resync and scrub progress and the most
+// recent events. "raidstat -v 1" turns the BW_DIAG lines on, "-v 0" off.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/fs.h"
+#include "kernel/raid.h"
+#include "kernel/raidstat.h"
+#include "user/user.h"
+
+#define NSHOW 16 // events printed
+
+static char *names[NRSEVENT] = {
+    [RS_WRITE] "write",       [RS_SKIP_DISK] "skip-disk",
+    [RS_SKIP_BLOCK] "skip-blk", [RS_WRITE_ERR] "write-err",
+    [RS_READ] "read",         [RS_FALLBACK] "fallback",
+};
+
+struct raidstat st;
+
+int main(int argc, char *argv[])
+{
+    struct resyncstat rs;
+    struct scrubstat ss;
+    struct raidevent *ev[NSHOW], *e;
+    int n = 0, i, j;
+
+    if (argc == 3 && strcmp(argv[1], "-v") == 0)
+    {
+        if (raidverbose(atoi(argv[2])) < 0)
+            exit(1);
+        exit(0);
+    }
+    if (argc != 1)
+    {
+        fprintf(2, "usage: raidstat [-v 0|1]\n");
+        exit(1);
+    }
+
+    if (raidstat(&st) < 0 || resync_status(&rs) < 0 || scrub_status(&ss) < 0)
+    {
+        fprintf(2, "raidstat: cannot get stats\n");
+        exit(1);
+    }
+
+    printf("event      copy0 copy1 copy2 copy3\n");
+    for (i = 0; i < NRSEVENT; i++)
+    {
+        printf("%s", names[i]);
+        for (j = strlen(names[i]); j < 10; j++)
+            printf(" ");
+        for (j = 0; j < RS_NCOPY; j++)
+            printf(" %d", st.count[i][j]);
+        printf("\n");
+    }
+    printf("verbose %d\n", st.verbose);
+    if (rs.stale >= 0)
+        printf("resync: disk %d lacks %d blocks%s, %d copied\n", rs.stale,
+               rs.ndirty, rs.waiting ? " (still failed)" : "", rs.copied);
+    else
+        printf("resync: in sync, %d copied\n", rs.copied);
+    printf("scrub: pass %d at block %d of %d, %d scanned, %d mismatched, "
+           "%d repaired, %d unfixable\n",
+           ss.passes, ss.cursor, ss.size, ss.scanned, ss.mismatches,
+           ss.repaired, ss.unfixable);
+
+    // keep the NSHOW latest events, newest first.
+    for (i = 0; i < NCPU * RS_RING; i++)
+    {
+        e = &st.ev[i];
+        if (e->seq == 0 || (n == NSHOW && e->seq <= ev[n - 1]->seq))
+            continue;
+        if (n < NSHOW)
+            n++;
+        for (j = n - 1; j > 0 && ev[j - 1]->seq < e->seq; j--)
+            ev[j] = ev[j - 1];
+        ev[j] = e;
+    }
+    for (i = 0; i < n; i++)
+        printf("#%d %s copy %d block %d pbn %d\n", ev[i]->seq,
+               names[ev[i]->type], ev[i]->copy, ev[i]->blockno,
+               ev[i]->pblockno);
+    exit(0);
+}
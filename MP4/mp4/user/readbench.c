@@ -0,0 +1,74 @@
+// Measure read throughput with one and with two concurrent readers.
+// The file is larger than the buffer cache, so every pass goes to the
+// disk, and two readers can be served by both RAID-1 mirrors at once.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+
+#define FILE "readbench.dat"
+#define NBLOCK 200
+#define NPASS 4
+
+char buf[BSIZE];
+
+static void readpasses(int npass)
+{
+    int fd;
+
+    for (int i = 0; i < npass; i++)
+    {
+        if ((fd = open(FILE, O_RDONLY)) < 0)
+        {
+            fprintf(2, "readbench: cannot open %s\n", FILE);
+            exit(1);
+        }
+        while (read(fd, buf, sizeof(buf)) == sizeof(buf))
+            ;
+        close(fd);
+    }
+}
+
+// Read the file 2 * NPASS times in total, split among nreaders
+// processes, and return the elapsed ticks.
+static int run(int nreaders)
+{
+    int t0 = uptime();
+
+    for (int i = 0; i < nreaders; i++)
+    {
+        if (fork() == 0)
+        {
+            readpasses(2 * NPASS / nreaders);
+            exit(0);
+        }
+    }
+    for (int i = 0; i < nreaders; i++)
+        wait(0);
+    return uptime() - t0;
+}
+
+int main(int argc, char *argv[])
+{
+    int fd, t1, t2;
+
+    if ((fd = open(FILE, O_CREATE | O_WRONLY)) < 0)
+    {
+        fprintf(2, "readbench: cannot create %s\n", FILE);
+        exit(1);
+    }
+    memset(buf, 'r', sizeof(buf));
+    for (int i = 0; i < NBLOCK; i++)
+        write(fd, buf, sizeof(buf));
+    close(fd);
+
+    t1 = run(1);
+    t2 = run(2);
+    printf("1 reader: %d ticks, 2 readers: %d ticks for %d KB\n", t1, t2,
+           2 * NPASS * NBLOCK);
+
+    unlink(FILE);
+    exit(0);
+}
@@ -0,0 +1,69 @@
+// Measure read/write throughput through a pipe for buffer sizes from
+// 1 byte to 64 KB. Small sizes show the cost of a system call, large
+// ones the cost of copyin/copyout.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/param.h"
+
+#define TOTAL (256 * 1024) // bytes moved per size
+#define MAXBUF (64 * 1024)
+
+int sizes[] = {1, 64, 512, 4096, MAXBUF};
+char wbuf[MAXBUF], rbuf[MAXBUF];
+
+// Move TOTAL bytes through a pipe in size-byte writes and reads, and
+// return the elapsed ticks.
+static int run(int size)
+{
+    int fds[2], n, got, t0;
+
+    if (pipe(fds) < 0)
+    {
+        fprintf(2, "rwbench: pipe failed\n");
+        exit(1);
+    }
+    t0 = uptime();
+    if (fork() == 0)
+    {
+        close(fds[0]);
+        for (int i = 0; i < TOTAL; i += size)
+        {
+            if (write(fds[1], wbuf, size) != size)
+            {
+                fprintf(2, "rwbench: write failed\n");
+                exit(1);
+            }
+        }
+        exit(0);
+    }
+    close(fds[1]);
+    for (got = 0; got < TOTAL; got += n)
+    {
+        if ((n = read(fds[0], rbuf, size)) <= 0)
+        {
+            fprintf(2, "rwbench: read failed\n");
+            exit(1);
+        }
+    }
+    close(fds[0]);
+    wait(0);
+    return uptime() - t0;
+}
+
+int main(int argc, char *argv[])
+{
+    int t;
+
+    memset(wbuf, 'w', sizeof(wbuf));
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        t = run(sizes[i]);
+        if (t == 0)
+            t = 1;
+        printf("%d bytes: %d writes in %d ticks, %d KB/s\n", sizes[i],
+               TOTAL / sizes[i], t, TOTAL / 1024 * HZ / t);
+    }
+    exit(0);
+}
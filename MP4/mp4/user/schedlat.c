@@ -0,0 +1,78 @@
+// Measure how long short commands take to run while CPU hogs keep
+// every hart busy, the way a shell runs them: fork, exec, wait.
+// Compare a kernel built with "make SCHED=MLFQ" against round-robin.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/param.h"
+
+#define NCMD 20
+#define MAXHOG 16
+
+char *argv_echo[] = {"echo", "schedlat", 0};
+
+static void hog(void)
+{
+    volatile unsigned x = 0;
+
+    for (;;)
+        x++;
+}
+
+// Run NCMD commands one at a time and return the elapsed microseconds.
+static uint64 commands(void)
+{
+    uint64 t0 = uptimeus();
+    int pid;
+
+    for (int i = 0; i < NCMD; i++)
+    {
+        if ((pid = fork()) < 0)
+        {
+            fprintf(2, "schedlat: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0)
+        {
+            // the shell would write to the console; don't.
+            close(1);
+            exec(argv_echo[0], argv_echo);
+            exit(1);
+        }
+        wait(0);
+    }
+    return uptimeus() - t0;
+}
+
+int main(int argc, char *argv[])
+{
+    int nhog = 4, pids[MAXHOG];
+    uint64 t;
+
+    if (argc > 1)
+        nhog = atoi(argv[1]);
+    if (nhog < 0 || nhog > MAXHOG)
+    {
+        fprintf(2, "usage: schedlat [hogs, 0-%d]\n", MAXHOG);
+        exit(1);
+    }
+
+    t = commands();
+    printf("no hogs: %d us per command\n", (int)(t / NCMD));
+
+    for (int i = 0; i < nhog; i++)
+        if ((pids[i] = fork()) == 0)
+            hog();
+    // let the hogs use up their first quanta.
+    sleep(HZ);
+
+    t = commands();
+    printf("%d hogs: %d us per command\n", nhog, (int)(t / NCMD));
+
+    for (int i = 0; i < nhog; i++)
+        kill(pids[i]);
+    for (int i = 0; i < nhog; i++)
+        wait(0);
+    exit(0);
+}
@@ -0,0 +1,158 @@
+// Move the same bytes from a producer to a consumer through a pipe and
+// through a ring in a shared memory segment, which the two copy in and
+// out of themselves and wait on with futexes.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/param.h"
+
+#define TOTAL (2 * 1024 * 1024)
+#define CHUNK 4096
+#define RING (15 * 4096)
+
+struct ring
+{
+    int head; // bytes produced
+    int tail; // bytes consumed
+    char data[RING];
+};
+
+char buf[CHUNK];
+
+// Wait until *p is no longer val.
+static void waitfor(int *p, int val)
+{
+    while (*(volatile int *)p == val)
+        futexwait(p, val);
+}
+
+static void produce(struct ring *r)
+{
+    int head = 0, m, n;
+
+    memset(buf, 'p', sizeof(buf));
+    while (head < TOTAL)
+    {
+        int tail = *(volatile int *)&r->tail;
+        if (head - tail == RING)
+        {
+            waitfor(&r->tail, tail);
+            continue;
+        }
+        // up to a chunk, within what is free and before the ring wraps.
+        n = RING - (head - tail);
+        m = RING - head % RING;
+        if (n > m)
+            n = m;
+        if (n > CHUNK)
+            n = CHUNK;
+        memcpy(r->data + head % RING, buf, n);
+        __sync_synchronize();
+        head += n;
+        r->head = head;
+        futexwake(&r->head, 1);
+    }
+}
+
+static int consume(struct ring *r)
+{
+    int tail = 0, got = 0, m, n;
+
+    while (tail < TOTAL)
+    {
+        int head = *(volatile int *)&r->head;
+        if (head == tail)
+        {
+            waitfor(&r->head, head);
+            continue;
+        }
+        n = head - tail;
+        m = RING - tail % RING;
+        if (n > m)
+            n = m;
+        if (n > CHUNK)
+            n = CHUNK;
+        memcpy(buf, r->data + tail % RING, n);
+        for (int i = 0; i < n; i += 512)
+            got += buf[i] == 'p';
+        __sync_synchronize();
+        tail += n;
+        r->tail = tail;
+        futexwake(&r->tail, 1);
+    }
+    return got;
+}
+
+static int pipes(void)
+{
+    int fds[2], n, t0 = uptime();
+
+    if (pipe(fds) < 0)
+    {
+        fprintf(2, "shmbench: pipe failed\n");
+        exit(1);
+    }
+    if (fork() == 0)
+    {
+        close(fds[0]);
+        memset(buf, 'p', sizeof(buf));
+        for (int i = 0; i < TOTAL; i += CHUNK)
+            write(fds[1], buf, CHUNK);
+        exit(0);
+    }
+    close(fds[1]);
+    for (int i = 0; i < TOTAL; i += n)
+    {
+        if ((n = read(fds[0], buf, CHUNK)) <= 0)
+        {
+            fprintf(2, "shmbench: short pipe\n");
+            exit(1);
+        }
+    }
+    close(fds[0]);
+    wait(0);
+    return uptime() - t0;
+}
+
+static int shared(void)
+{
+    struct ring *r;
+    int id, t0 = uptime();
+
+    if ((id = shmget(0, sizeof(struct ring))) < 0 ||
+        (r = shmat(id)) == (struct ring *)-1)
+    {
+        fprintf(2, "shmbench: cannot get a segment\n");
+        exit(1);
+    }
+    shmrm(id); // it goes away once both processes have unmapped it
+    // the child inherits the mapping.
+    if (fork() == 0)
+    {
+        produce(r);
+        exit(0);
+    }
+    if (consume(r) != TOTAL / 512)
+    {
+        fprintf(2, "shmbench: wrong data\n");
+        exit(1);
+    }
+    wait(0);
+    munmap(r, sizeof(struct ring));
+    return uptime() - t0;
+}
+
+static void report(char *what, int t)
+{
+    if (t == 0)
+        t = 1;
+    printf("%s: %d ticks, %d KB/s\n", what, t, TOTAL / 1024 * HZ / t);
+}
+
+int main(int argc, char *argv[])
+{
+    report("pipe", pipes());
+    report("shm+futex", shared());
+    exit(0);
+}
@@ -0,0 +1,52 @@
+// Make the kernel touch many physical pages through its direct map,
+// which is where megapages save TLB misses: first-touch faults zero a
+// new page each, and copy-on-write faults copy one.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/param.h"
+
+#define NPAGE 2048 // 8 MB
+#define PGSIZE 4096
+
+static void report(char *what, int t)
+{
+    if (t == 0)
+        t = 1;
+    printf("%s: %d pages in %d ticks, %d us per page\n", what, NPAGE, t,
+           t * (1000000 / HZ) / NPAGE);
+}
+
+int main(int argc, char *argv[])
+{
+    char *mem;
+    int t, pid;
+
+    if ((mem = sbrk(NPAGE * PGSIZE)) == (char *)-1)
+    {
+        fprintf(2, "tlbbench: sbrk failed\n");
+        exit(1);
+    }
+
+    t = uptime();
+    for (int i = 0; i < NPAGE; i++)
+        mem[i * PGSIZE] = 1;
+    report("zero-fill", uptime() - t);
+
+    t = uptime();
+    if ((pid = fork()) < 0)
+    {
+        fprintf(2, "tlbbench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0)
+    {
+        for (int i = 0; i < NPAGE; i++)
+            mem[i * PGSIZE] = 2;
+        exit(0);
+    }
+    wait(0);
+    report("copy-on-write", uptime() - t);
+    exit(0);
+}
@@ -1,5 +1,10 @@
 struct stat;
 struct rtcdate;
+struct resyncstat;
+struct raidstat;
+struct scrubstat;
+struct rawvec;
+struct fextent;
 
 // system calls
 int fork(void);
@@ -32,6 +37,24 @@ int raw_read(int pbn, char *buf);
 int get_disk_lbn(int fd, int file_lbn);
 int raw_write(int pbn, char *buf);
 int force_disk_fail(int disk_id);
+int openat(int dirfd, const char *, int);
+int fstatat(int dirfd, const char *, struct stat *);
+int resync_status(struct resyncstat *);
+int raidstat(struct raidstat *);
+int raidverbose(int);
+int scrub_status(struct scrubstat *);
+int raw_readv(struct rawvec *, int, int);
+int raw_writev(struct rawvec *, int, int);
+int fiemap(int, int, struct fextent *, int);
+int usleep(int);
+void *mmap(void *, int, int, int, int, int);
+int munmap(void *, int);
+int shmget(int, int);
+void *shmat(int);
+int futexwait(int *, int);
+int futexwake(int *, int);
+uint64 uptimeus(void);
+int shmrm(int);
 
 // ulib.c
 int stat(const char *, struct stat *);
@@ -46,3 +46,21 @@ entry("force_disk_fail");
 # TODO: Access Control
 entry("symlink");
 entry("chmod");
+entry("openat");
+entry("fstatat");
+entry("resync_status");
+entry("raidstat");
+entry("raidverbose");
+entry("scrub_status");
+entry("raw_readv");
+entry("raw_writev");
+entry("fiemap");
+entry("usleep");
+entry("mmap");
+entry("munmap");
+entry("shmget");
+entry("shmat");
+entry("futexwait");
+entry("futexwake");
+entry("uptimeus");
+entry("shmrm");